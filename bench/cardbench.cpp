@@ -0,0 +1,363 @@
+/**
+ * @file	cardbench.cpp
+ * @brief	カード操作の単位時間あたりの処理量
+ *
+ * HkNfcRw::detect()の検出枚数/s、HkNfcRw::isPresent()の確認回数/s、HkNfcF::read()の読み込みブロック数/s、
+ * HkNfcDep(InDataExchange)とLLCP/SNEP(PUT)の転送バイト数/sを、p50/p99の時間と一緒に表示する.
+ *
+ * BACKEND=simでビルドするとdevaccess_sim.cpp(libhknfcrws.a)を、
+ * BACKEND=ptyでビルドするとptyのRC-S620/Sもどきを相手にする.
+ * ptyのもどきはFeliCaにしか応答しないので、DEP/SNEPはsimのときだけ測る.
+ * BACKEND=replayでビルドすると、-rで渡したキャプチャ(devaccess_replay.cpp, libhknfcrwr.a)を相手にする.
+ * replayはsimで取ったキャプチャを、取ったときと同じ -n / -s で再生すること.
+ *
+ * 使い方: cardbench [-n 回数] [-s SNEP回数] [-l RF遅延[usec](simのみ)] [-w](simのみ:UART転送時間を待つ)
+ *                   [-c キャプチャ出力] [-r キャプチャ(replayのみ)] [-t](replayのみ:キャプチャ時の間隔で返す) [-a] [-v] [-f](simのみ)
+ * 	-a を指定すると、HkNfcRw::setAdaptiveDetect()で探索順を検出実績で入れ替える.
+ * 	-v を指定すると、最後にNfcPcdのコマンドごとの統計を出す.
+ * 	-f を指定すると、DevSim::injectFault()で異常を1回ずつ起こし、コマンドの結果とResync/Retryの回数、
+ * 	   直後のコマンドが通ることを確かめる(違っていたら終了コード1).
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+
+#include "HkNfcRw.h"
+#include "HkNfcF.h"
+#include "HkNfcDep.h"
+#include "HkNfcSnep.h"
+#include "HkNfcNdef.h"
+#include "NfcPcd.h"
+#if defined(BENCH_SIM)
+#include "devaccess_sim.h"
+#elif defined(BENCH_REPLAY)
+#include "devaccess_replay.h"
+#else
+#include "ptypcd.h"
+#endif
+
+namespace {
+	int s_Loop = 1000;
+	int s_SnepLoop = 20;
+	int s_Result = 0;
+
+	/// DEPで1回に送るデータ長(InDataExchangeの上限)
+	const uint8_t DEP_LEN = 252;
+
+	uint8_t s_Buf[HkNfcF::BLOCK_SIZE * HkNfcF::READ_BLOCK_MAX];
+	uint8_t s_DepBuf[DEP_LEN];
+	HkNfcNdefMsg s_Msg;
+
+	double now_us()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+	}
+
+	bool detect()
+	{
+		return HkNfcRw::detect(true, true, true) != HkNfcRw::NFC_NONE;
+	}
+
+	bool present()
+	{
+		return HkNfcRw::isPresent();
+	}
+
+	bool read1()
+	{
+		return HkNfcF::read(s_Buf, 0);
+	}
+
+	bool read15()
+	{
+		return HkNfcF::readBlocks(HkNfcF::SVCCODE_RW, 0, HkNfcF::READ_BLOCK_MAX, s_Buf);
+	}
+
+#if defined(BENCH_SIM) || defined(BENCH_REPLAY)
+	bool depExchange()
+	{
+		uint8_t len;
+		bool b = HkNfcDep::sendAsInitiator(s_DepBuf, DEP_LEN, s_DepBuf, &len);
+		return b && (len == DEP_LEN);
+	}
+
+	/// リンク確立からDMまでのSNEP PUT 1回
+	bool snepPut()
+	{
+		if(!HkNfcSnep::putStart(HkNfcSnep::MD_INITIATOR, &s_Msg)) {
+			return false;
+		}
+		while(HkNfcSnep::poll()) {
+			;
+		}
+		return HkNfcSnep::getResult() == HkNfcSnep::SUCCESS;
+	}
+#endif
+
+	struct Op {
+		const char*		pName;
+		bool			(*pFunc)();
+		double			Units;			///< 1回あたりの処理量
+		const char*		pUnit;
+	};
+
+	void run(const Op& op, int loop)
+	{
+		std::vector<double> lat;
+		lat.reserve(loop);
+		int err = 0;
+
+		double start = now_us();
+		for(int i = 0; i < loop; i++) {
+			double t = now_us();
+			if(!op.pFunc()) {
+				err++;
+			}
+			lat.push_back(now_us() - t);
+		}
+		double sec = (now_us() - start) / 1e6;
+
+		std::sort(lat.begin(), lat.end());
+		printf("%-20s %6d %9.1f %9.1f %9.1f %11.1f %-6s %d\n",
+				op.pName, loop,
+				lat[lat.size() / 2], lat[lat.size() * 99 / 100],
+				loop / sec, (loop - err) * op.Units / sec, op.pUnit,
+				err);
+
+		if(err) {
+			s_Result = 1;
+		}
+	}
+
+#if defined(BENCH_SIM)
+	/// 異常を起こしたときに期待する結果
+	struct FaultCase {
+		const char*		pName;
+		DevSim::Fault	Fault;
+		uint8_t			RetryLimit;		///< NfcPcd::setRetryLimit()
+		bool			bIdempotent;	///< true:GetGeneralStatus(送り直す) / false:HkNfcF::read()(送り直さない)
+		bool			bResult;		///< コマンドの結果
+		uint32_t		Resync;			///< 統計のResync
+		uint32_t		Retry;			///< 統計のRetry
+	};
+
+	const FaultCase FAULT_CASES[] = {
+		{ "NO_ACK",		DevSim::FAULT_NO_ACK,	0, true,	false,	0, 0 },
+		{ "NO_ACK",		DevSim::FAULT_NO_ACK,	1, true,	true,	0, 1 },
+		{ "NO_RESP",	DevSim::FAULT_NO_RESP,	0, true,	false,	0, 0 },
+		{ "NO_RESP",	DevSim::FAULT_NO_RESP,	1, true,	true,	0, 1 },
+		{ "ERRFRAME",	DevSim::FAULT_ERRFRAME,	0, true,	false,	0, 0 },
+		{ "ERRFRAME",	DevSim::FAULT_ERRFRAME,	1, true,	true,	0, 1 },
+		{ "BAD_DCS",	DevSim::FAULT_BAD_DCS,	0, true,	false,	0, 0 },
+		{ "BAD_DCS",	DevSim::FAULT_BAD_DCS,	1, true,	true,	0, 1 },
+		{ "BAD_DCS",	DevSim::FAULT_BAD_DCS,	1, false,	false,	0, 0 },
+		{ "NOISE",		DevSim::FAULT_NOISE,	0, true,	true,	2, 0 },
+		{ "NOISE",		DevSim::FAULT_NOISE,	0, false,	true,	2, 0 },
+	};
+
+	bool faultCmd(bool bIdempotent)
+	{
+		if(bIdempotent) {
+			uint8_t st[5];
+			return NfcPcd::getGeneralStatus(st);
+		}
+		return read1();
+	}
+
+	/// 異常を1回起こしてコマンドを送り、期待した結果になったか確かめる
+	void runFault(const FaultCase& fc)
+	{
+		const uint8_t code = (fc.bIdempotent) ? 0x04 : 0xa0;	//GetGeneralStatus / CommunicateThruEX
+
+		NfcPcd::setRetryLimit(fc.RetryLimit);
+		NfcPcd::clearStat();
+		DevSim::injectFault(fc.Fault, 1);
+		bool ret = faultCmd(fc.bIdempotent);
+		DevSim::injectFault(DevSim::FAULT_NONE, 0);
+		const NfcPcd::CmdStat* st = NfcPcd::getStat(code);
+		uint32_t resync = (st) ? st->Resync : 0;
+		uint32_t retry = (st) ? st->Retry : 0;
+
+		//残ったバイトやPCDの状態で、次のコマンドが失敗しないこと
+		bool next = faultCmd(fc.bIdempotent);
+
+		bool ok = (ret == fc.bResult) && (resync == fc.Resync) && (retry == fc.Retry) && next;
+		printf("%-10s %02x %5u %-6s %6u %6u %-6s %s\n",
+				fc.pName, code, fc.RetryLimit,
+				(ret) ? "ok" : "fail", resync, retry,
+				(next) ? "ok" : "fail",
+				(ok) ? "" : "NG");
+		if(!ok) {
+			s_Result = 1;
+		}
+	}
+#endif
+}
+
+
+int main(int argc, char* argv[])
+{
+	uint32_t latency = 0;
+	bool wire = false;
+	bool verbose = false;
+	const char* capture = 0;
+	const char* replay = 0;
+	bool timing = false;
+	bool adaptive = false;
+	bool fault = false;
+	int opt;
+	while((opt = getopt(argc, argv, "n:s:l:wc:r:tavf")) != -1) {
+		switch(opt) {
+		case 'n':
+			s_Loop = atoi(optarg);
+			break;
+		case 's':
+			s_SnepLoop = atoi(optarg);
+			break;
+		case 'l':
+			latency = (uint32_t)atoi(optarg);
+			break;
+		case 'w':
+			wire = true;
+			break;
+		case 'c':
+			capture = optarg;
+			break;
+		case 'r':
+			replay = optarg;
+			break;
+		case 't':
+			timing = true;
+			break;
+		case 'a':
+			adaptive = true;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		case 'f':
+			fault = true;
+			break;
+		default:
+			printf("usage: %s [-n loop] [-s snep loop] [-l rf latency(usec)] [-w] [-c capture] [-r replay] [-t] [-a] [-v] [-f]\n", argv[0]);
+			return 2;
+		}
+	}
+	if(s_Loop <= 0) {
+		s_Loop = 1;
+	}
+	if(s_SnepLoop <= 0) {
+		s_SnepLoop = 1;
+	}
+
+#if defined(BENCH_SIM)
+	(void)replay;
+	(void)timing;
+	const char* path = 0;
+	DevSim::setRfLatency(latency);
+	DevSim::setWireDelay(wire);
+	DevSim::setDepTarget(true);
+	const char* backend = "sim";
+#elif defined(BENCH_REPLAY)
+	(void)latency;
+	(void)wire;
+	(void)fault;
+	const char* path = replay;
+	DevReplay::setTiming(timing);
+	const char* backend = "replay";
+#else
+	(void)latency;
+	(void)wire;
+	(void)replay;
+	(void)timing;
+	(void)fault;
+	const char* path = PtyPcd::start(PtyPcd::felicaHandler);
+	if(!path) {
+		return 1;
+	}
+	const char* backend = path;
+#endif
+	if(capture && !NfcPcd::startCapture(capture)) {
+		return 1;
+	}
+	if(!HkNfcRw::open(path)) {
+		printf("open fail\n");
+		HkNfcRw::close();
+		NfcPcd::stopCapture();
+#if !defined(BENCH_SIM) && !defined(BENCH_REPLAY)
+		PtyPcd::stop();
+#endif
+		return 1;
+	}
+	HkNfcRw::setAdaptiveDetect(adaptive);
+
+	printf("%d loops (%s)\n", s_Loop, backend);
+	printf("%-20s %6s %9s %9s %9s %18s %s\n",
+			"operation", "loop", "p50[us]", "p99[us]", "ops/s", "throughput", "err");
+
+	const Op detectOp = { "detect",		detect,		1,	"card/s" };
+	const Op presentOp = { "isPresent",		present,	1,	"chk/s" };
+	const Op readOp = { "HkNfcF::read",		read1,		1,	"blk/s" };
+	const Op readMaxOp = { "HkNfcF::readBlocks",	read15,		HkNfcF::READ_BLOCK_MAX,	"blk/s" };
+	run(detectOp, s_Loop);
+	run(presentOp, s_Loop);
+	run(readOp, s_Loop);
+	run(readMaxOp, s_Loop);
+
+#if defined(BENCH_SIM)
+	if(fault) {
+		//HkNfcF::read()の相手は、上で選択したままのカード
+		printf("\n%-10s %2s %5s %-6s %6s %6s %-6s\n",
+				"fault", "cmd", "limit", "result", "resync", "retry", "next");
+		for(size_t i = 0; i < sizeof(FAULT_CASES) / sizeof(FAULT_CASES[0]); i++) {
+			runFault(FAULT_CASES[i]);
+		}
+		NfcPcd::setRetryLimit(0);
+		NfcPcd::clearStat();
+		printf("\n");
+	}
+#endif
+	HkNfcRw::release();
+
+#if defined(BENCH_SIM) || defined(BENCH_REPLAY)
+	//DEP : 送ったデータがそのまま返ってくるので、送受信の合計
+	const Op depOp = { "HkNfcDep(252B)",	depExchange,	DEP_LEN * 2,	"B/s" };
+	if(HkNfcDep::startAsInitiator(HkNfcDep::PSV_424K, false)) {
+		run(depOp, s_Loop);
+		HkNfcDep::stopAsInitiator();
+		HkNfcDep::close();
+	} else {
+		printf("%-20s start fail\n", depOp.pName);
+		s_Result = 1;
+	}
+
+	//SNEP : リンク確立・CONNECT・PUT・DISC・RLS_REQまでを1回とし、NDEFメッセージ長で数える
+	//SNEPヘッダ(6byte)とTEXTレコードのヘッダ(7byte)を足してMIUに収まる最大
+	std::memset(s_DepBuf, 'a', HkNfcDep::LLCP_MIU);
+	HkNfcNdef::createText(&s_Msg, s_DepBuf, HkNfcDep::LLCP_MIU - 6 - 7);
+	const Op snepOp = { "SNEP PUT",	snepPut,	(double)s_Msg.Length,	"B/s" };
+	run(snepOp, s_SnepLoop);
+#endif
+
+	if(verbose) {
+		NfcPcd::printStat(stdout, backend);
+	}
+	HkNfcRw::close();
+	NfcPcd::stopCapture();
+#if defined(BENCH_REPLAY)
+	if(DevReplay::mismatch() || !DevReplay::isEnd()) {
+		printf("replay : %u mismatch%s\n", DevReplay::mismatch(), DevReplay::isEnd() ? "" : ", records left");
+		s_Result = 1;
+	}
+#elif !defined(BENCH_SIM)
+	PtyPcd::stop();
+#endif
+
+	return s_Result;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file	loopback.cpp
+ * @brief	ptyのRC-S620/Sもどきに対するコマンドごとのシステムコール数・転送量・時間
+ *
+ * 擬似端末のmaster側でPtyPcd(FeliCaカードあり)を動かし、slave側をdevaccess_uart.cppで開く.
+ * NfcPcd/HkNfcFのコマンドを繰り返し、1コマンドあたりの
+ * read/write/select/sync回数、送受信バイト数、時間を表示する.
+ *
+ * 使い方: loopback [-n 回数] [-p none|drain|fsync] [-m 上限]
+ * 	-m を指定すると、1コマンドあたりのシステムコール数がそれを超えたときに1で終了する.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+
+#include "HkNfcRw.h"
+#include "HkNfcF.h"
+#include "NfcPcd.h"
+#include "devaccess.h"
+#include "ptypcd.h"
+#include "syscount.h"
+
+namespace {
+	int s_Loop = 1000;
+	double s_Limit = 0;
+	int s_Result = 0;
+
+	uint8_t s_Buf[HkNfcF::BLOCK_SIZE * 12];
+
+	double now_us()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+	}
+
+	bool getFirmware()	{ return NfcPcd::getFirmwareVersion(0); }
+	bool rfOff()		{ return NfcPcd::rfOff(); }
+	bool pollingF()		{ return HkNfcF::polling(); }
+	bool read1()		{ return HkNfcF::read(s_Buf, 0); }
+	bool read12()		{ return HkNfcF::readBlocks(HkNfcF::SVCCODE_RW, 0, 12, s_Buf); }
+	bool write12()		{ return HkNfcF::writeBlocks(HkNfcF::SVCCODE_RW, 0, 12, s_Buf); }
+
+	struct Cmd {
+		const char*		pName;
+		bool			(*pFunc)();
+	};
+	const Cmd CMDS[] = {
+		{ "GetFirmwareVersion",		getFirmware },
+		{ "RFConfiguration",		rfOff },
+		{ "Polling(F)",				pollingF },
+		{ "Read x1",				read1 },
+		{ "Read x12",				read12 },
+		{ "Write x12",				write12 },
+	};
+
+	void run(const Cmd& cmd)
+	{
+		std::vector<double> lat;
+		lat.reserve(s_Loop);
+		int err = 0;
+
+		SysCount::clear();
+		SysCount::start();
+		for(int i = 0; i < s_Loop; i++) {
+			double t = now_us();
+			if(!cmd.pFunc()) {
+				err++;
+			}
+			lat.push_back(now_us() - t);
+		}
+		SysCount::stop();
+
+		const SysCount::Count& c = SysCount::get();
+		std::sort(lat.begin(), lat.end());
+		double n = s_Loop;
+		printf("%-20s %7.1f %7.1f | %5.2f %5.2f %5.2f %5.2f %6.2f | %6.1f %6.1f | %d\n",
+				cmd.pName,
+				lat[lat.size() / 2], lat[lat.size() * 99 / 100],
+				c.Read / n, c.Write / n, c.Select / n, c.Sync / n, c.total() / n,
+				c.TxBytes / n, c.RxBytes / n,
+				err);
+
+		if(err || ((s_Limit > 0) && (c.total() / n > s_Limit))) {
+			s_Result = 1;
+		}
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	DevAccess::WritePolicy policy = DevAccess::WP_NONE;
+	int opt;
+	while((opt = getopt(argc, argv, "n:p:m:")) != -1) {
+		switch(opt) {
+		case 'n':
+			s_Loop = atoi(optarg);
+			break;
+		case 'p':
+			if(strcmp(optarg, "drain") == 0) {
+				policy = DevAccess::WP_DRAIN;
+			} else if(strcmp(optarg, "fsync") == 0) {
+				policy = DevAccess::WP_FSYNC;
+			}
+			break;
+		case 'm':
+			s_Limit = atof(optarg);
+			break;
+		default:
+			printf("usage: %s [-n loop] [-p none|drain|fsync] [-m max syscalls/cmd]\n", argv[0]);
+			return 2;
+		}
+	}
+	if(s_Loop <= 0) {
+		s_Loop = 1;
+	}
+
+	const char* path = PtyPcd::start(PtyPcd::felicaHandler);
+	if(!path) {
+		return 1;
+	}
+	if(!HkNfcRw::open(path)) {
+		printf("open fail\n");
+		HkNfcRw::close();
+		PtyPcd::stop();
+		return 1;
+	}
+	DevAccess::setWritePolicy(policy);
+
+	printf("%d loops (%s)\n", s_Loop, path);
+	printf("%-20s %7s %7s | %5s %5s %5s %5s %6s | %6s %6s | %s\n",
+			"command", "p50[us]", "p99[us]",
+			"read", "write", "wait", "sync", "total",
+			"tx[B]", "rx[B]", "err");
+	for(size_t i = 0; i < sizeof(CMDS) / sizeof(CMDS[0]); i++) {
+		run(CMDS[i]);
+	}
+
+	HkNfcRw::close();
+	PtyPcd::stop();
+
+	return s_Result;
+}
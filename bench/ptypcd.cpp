@@ -0,0 +1,285 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+
+#include "ptypcd.h"
+
+namespace {
+	const uint16_t BUF_MAX = 1024;
+	const uint8_t ACK[] = { 0x00, 0x00, 0xff, 0x00, 0xff, 0x00 };
+
+	int s_Master = -1;
+	pthread_t s_Thread;
+	volatile bool s_bRun = false;
+	PtyPcd::Handler s_Handler = 0;
+
+	uint8_t s_RecvBuf[BUF_MAX];
+	uint16_t s_RecvLen = 0;
+
+	/**
+	 * フレーム送信
+	 */
+	void sendFrame(const uint8_t* pData, uint16_t len)
+	{
+		uint8_t buf[BUF_MAX];
+		uint16_t pos = 0;
+		buf[pos++] = 0x00;
+		buf[pos++] = 0x00;
+		buf[pos++] = 0xff;
+		if(len <= 255) {
+			buf[pos++] = uint8_t(len);
+			buf[pos++] = uint8_t(0 - len);
+		} else {
+			buf[pos++] = 0xff;
+			buf[pos++] = 0xff;
+			buf[pos++] = uint8_t(len >> 8);
+			buf[pos++] = uint8_t(len);
+			buf[pos++] = uint8_t(0 - buf[5] - buf[6]);
+		}
+		uint8_t sum = 0;
+		for(uint16_t i = 0; i < len; i++) {
+			sum += pData[i];
+		}
+		std::memcpy(buf + pos, pData, len);
+		pos += len;
+		buf[pos++] = uint8_t(0 - sum);
+		buf[pos++] = 0x00;
+
+		//ACKと応答は続けて返す
+		uint8_t out[BUF_MAX + sizeof(ACK)];
+		std::memcpy(out, ACK, sizeof(ACK));
+		std::memcpy(out + sizeof(ACK), buf, pos);
+		if(::write(s_Master, out, sizeof(ACK) + pos) < 0) {
+			perror("ptypcd write");
+		}
+	}
+
+	/**
+	 * 受信データからフレームを取り出して応答する
+	 */
+	void parse()
+	{
+		while(true) {
+			uint16_t i = 0;
+			while((i + 2 < s_RecvLen)
+			  && !((s_RecvBuf[i] == 0x00) && (s_RecvBuf[i+1] == 0x00) && (s_RecvBuf[i+2] == 0xff))) {
+				i++;
+			}
+			if(i) {
+				std::memmove(s_RecvBuf, s_RecvBuf + i, s_RecvLen - i);
+				s_RecvLen -= i;
+			}
+			if(s_RecvLen < 6) {
+				return;
+			}
+
+			uint16_t pos;
+			uint16_t len;
+			if((s_RecvBuf[3] == 0x00) && (s_RecvBuf[4] == 0xff)) {
+				//ACK(ホストからの中断)
+				std::memmove(s_RecvBuf, s_RecvBuf + 6, s_RecvLen - 6);
+				s_RecvLen -= 6;
+				continue;
+			} else if((s_RecvBuf[3] == 0xff) && (s_RecvBuf[4] == 0xff)) {
+				if(s_RecvLen < 8) {
+					return;
+				}
+				len = uint16_t((s_RecvBuf[5] << 8) | s_RecvBuf[6]);
+				pos = 8;
+			} else {
+				len = s_RecvBuf[3];
+				pos = 5;
+			}
+			if(s_RecvLen < pos + len + 2) {
+				return;
+			}
+
+			uint8_t resp[BUF_MAX];
+			uint16_t resp_len = s_Handler(s_RecvBuf + pos, len, resp);
+			if(resp_len) {
+				sendFrame(resp, resp_len);
+			}
+
+			uint16_t frm_len = pos + len + 2;
+			std::memmove(s_RecvBuf, s_RecvBuf + frm_len, s_RecvLen - frm_len);
+			s_RecvLen -= frm_len;
+		}
+	}
+
+	void* thread(void*)
+	{
+		while(s_bRun) {
+			struct pollfd pfd;
+			pfd.fd = s_Master;
+			pfd.events = POLLIN;
+			if(::poll(&pfd, 1, 100) <= 0) {
+				continue;
+			}
+			ssize_t sz = ::read(s_Master, s_RecvBuf + s_RecvLen, BUF_MAX - s_RecvLen);
+			if(sz <= 0) {
+				continue;
+			}
+			s_RecvLen += sz;
+			parse();
+		}
+		return 0;
+	}
+}
+
+
+namespace PtyPcd {
+
+/**
+ * 起動
+ *
+ * @param[in]	handler		応答を作る関数(0なら #defaultHandler)
+ * @return		slave側のパス(失敗時は0)
+ */
+const char* start(Handler handler/*=0*/)
+{
+	s_Handler = (handler) ? handler : defaultHandler;
+
+	s_Master = posix_openpt(O_RDWR | O_NOCTTY);
+	if((s_Master < 0) || (grantpt(s_Master) != 0) || (unlockpt(s_Master) != 0)) {
+		perror("posix_openpt");
+		return 0;
+	}
+	s_RecvLen = 0;
+	s_bRun = true;
+	pthread_create(&s_Thread, 0, thread, 0);
+
+	return ptsname(s_Master);
+}
+
+
+/**
+ * 停止
+ */
+void stop()
+{
+	if(s_bRun) {
+		s_bRun = false;
+		pthread_join(s_Thread, 0);
+		::close(s_Master);
+		s_Master = -1;
+	}
+}
+
+
+/**
+ * 標準の応答
+ */
+uint16_t defaultHandler(const uint8_t* pCmd, uint16_t CmdLen, uint8_t* pResp)
+{
+	if((CmdLen < 2) || (pCmd[0] != 0xd4)) {
+		//Error Frame
+		pResp[0] = 0x7f;
+		return 1;
+	}
+
+	uint16_t len = 0;
+	pResp[len++] = 0xd5;
+	pResp[len++] = uint8_t(pCmd[1] + 1);
+	switch(pCmd[1]) {
+	case 0x02:		//GetFirmwareVersion
+		pResp[len++] = 0x33;
+		pResp[len++] = 0x01;
+		pResp[len++] = 0x30;
+		pResp[len++] = 0x07;
+		break;
+	case 0x04:		//GetGeneralStatus
+		std::memset(pResp + len, 0x00, 5);
+		len += 5;
+		break;
+	case 0x4a:		//InListPassiveTarget : 見つからない
+		pResp[len++] = 0x00;
+		break;
+	case 0x40:		//InDataExchange
+	case 0x42:		//InCommunicateThru
+	case 0x52:		//InRelease
+		pResp[len++] = 0x01;		//Timeout
+		break;
+	case 0xa0:		//CommunicateThruEX
+		pResp[len++] = 0x80;		//Timeout
+		break;
+	default:
+		break;
+	}
+	return len;
+}
+
+
+/**
+ * FeliCaカード1枚をかざした応答
+ *
+ * InListPassiveTarget(212/424kbps)と、CommunicateThruEXのRequest Response, Read/Write Without Encryptionに応答する.
+ * 読み込みデータは0固定で、書き込みデータは捨てる.
+ */
+uint16_t felicaHandler(const uint8_t* pCmd, uint16_t CmdLen, uint8_t* pResp)
+{
+	const uint8_t IDM[] = { 0x01, 0x2e, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+	const uint8_t PMM[] = { 0x03, 0x01, 0x4b, 0x02, 0x4f, 0x49, 0x93, 0xff };
+
+	if((CmdLen >= 4) && (pCmd[0] == 0xd4) && (pCmd[1] == 0x4a)
+	  && ((pCmd[3] == 0x01) || (pCmd[3] == 0x02))) {
+		uint16_t len = 0;
+		pResp[len++] = 0xd5;
+		pResp[len++] = 0x4b;
+		pResp[len++] = 0x01;		//NbTg
+		pResp[len++] = 0x01;		//Tg
+		pResp[len++] = 0x14;		//POL_RES長
+		pResp[len++] = 0x01;
+		std::memcpy(pResp + len, IDM, sizeof(IDM));
+		len += sizeof(IDM);
+		std::memcpy(pResp + len, PMM, sizeof(PMM));
+		len += sizeof(PMM);
+		pResp[len++] = 0x12;		//System Code
+		pResp[len++] = 0xfc;
+		return len;
+	}
+
+	if((CmdLen >= 4 + 10) && (pCmd[0] == 0xd4) && (pCmd[1] == 0xa0) && (pCmd[5] == 0x04)) {
+		uint16_t len = 0;
+		pResp[len++] = 0xd5;
+		pResp[len++] = 0xa1;
+		pResp[len++] = 0x00;		//Status
+		pResp[len++] = 11;			//LEN
+		pResp[len++] = 0x05;
+		std::memcpy(pResp + len, pCmd + 6, 8);		//IDm
+		len += 8;
+		pResp[len++] = 0x00;		//Mode0
+		return len;
+	}
+
+	if((CmdLen >= 4 + 10) && (pCmd[0] == 0xd4) && (pCmd[1] == 0xa0)
+	  && ((pCmd[5] == 0x06) || (pCmd[5] == 0x08))) {
+		const uint8_t* f = pCmd + 4;
+		uint16_t len = 0;
+		pResp[len++] = 0xd5;
+		pResp[len++] = 0xa1;
+		pResp[len++] = 0x00;		//Status
+		pResp[len++] = 0x00;		//LEN(あとで設定)
+		pResp[len++] = uint8_t(f[1] + 1);
+		std::memcpy(pResp + len, f + 2, 8);		//IDm
+		len += 8;
+		pResp[len++] = 0x00;		//Status Flag1
+		pResp[len++] = 0x00;		//Status Flag2
+		if(f[1] == 0x06) {
+			uint8_t svc_num = f[10];
+			uint8_t blk_num = f[11 + svc_num * 2];
+			pResp[len++] = blk_num;
+			std::memset(pResp + len, 0x00, blk_num * 16);
+			len += blk_num * 16;
+		}
+		pResp[3] = uint8_t(len - 3);
+		return len;
+	}
+
+	return defaultHandler(pCmd, CmdLen, pResp);
+}
+
+}	//namespace PtyPcd
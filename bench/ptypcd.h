@@ -0,0 +1,35 @@
+#ifndef PTYPCD_H
+#define PTYPCD_H
+
+#include <stdint.h>
+
+/**
+ * @brief	pty上で動くRC-S620/Sもどき
+ *
+ * 擬似端末のmaster側でPCDのフレーム(ACK, Normal/Extendedフレーム, DCS)を解釈して応答する.
+ * slave側のパスをDevAccessに渡せば、実機なしでNfcPcdを動かせる.
+ */
+namespace PtyPcd {
+
+	/**
+	 * コマンドへの応答を作る関数
+	 *
+	 * @param[in]	pCmd		受信したコマンド(0xd4含む)
+	 * @param[in]	CmdLen		pCmdの長さ
+	 * @param[out]	pResp		応答(0xd5含む)
+	 * @return		pRespの長さ(0なら応答しない)
+	 */
+	typedef uint16_t (*Handler)(const uint8_t* pCmd, uint16_t CmdLen, uint8_t* pResp);
+
+	/// 起動(slave側のパスを返す)
+	const char* start(Handler handler=0);
+	/// 停止
+	void stop();
+
+	/// 標準の応答(d5, cmd+1と最低限のデータ)
+	uint16_t defaultHandler(const uint8_t* pCmd, uint16_t CmdLen, uint8_t* pResp);
+	/// FeliCaカードありの応答
+	uint16_t felicaHandler(const uint8_t* pCmd, uint16_t CmdLen, uint8_t* pResp);
+}
+
+#endif /* PTYPCD_H */
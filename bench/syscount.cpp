@@ -0,0 +1,116 @@
+#include <cstring>
+#include <unistd.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/select.h>
+#include <sys/uio.h>
+
+#include "syscount.h"
+
+namespace {
+	__thread bool s_bCount = false;
+	SysCount::Count s_Count;
+}
+
+extern "C" {
+	ssize_t __real_read(int fd, void* buf, size_t len);
+	ssize_t __real_write(int fd, const void* buf, size_t len);
+	ssize_t __real_writev(int fd, const struct iovec* iov, int num);
+	int __real_select(int nfds, fd_set* rd, fd_set* wr, fd_set* ex, struct timeval* tv);
+	int __real_poll(struct pollfd* fds, nfds_t num, int timeout);
+	int __real_fsync(int fd);
+	int __real_tcdrain(int fd);
+
+	ssize_t __wrap_read(int fd, void* buf, size_t len)
+	{
+		ssize_t ret = __real_read(fd, buf, len);
+		if(s_bCount) {
+			s_Count.Read++;
+			if(ret > 0) {
+				s_Count.RxBytes += ret;
+			}
+		}
+		return ret;
+	}
+
+	ssize_t __wrap_write(int fd, const void* buf, size_t len)
+	{
+		ssize_t ret = __real_write(fd, buf, len);
+		if(s_bCount) {
+			s_Count.Write++;
+			if(ret > 0) {
+				s_Count.TxBytes += ret;
+			}
+		}
+		return ret;
+	}
+
+	ssize_t __wrap_writev(int fd, const struct iovec* iov, int num)
+	{
+		ssize_t ret = __real_writev(fd, iov, num);
+		if(s_bCount) {
+			s_Count.Write++;
+			if(ret > 0) {
+				s_Count.TxBytes += ret;
+			}
+		}
+		return ret;
+	}
+
+	int __wrap_select(int nfds, fd_set* rd, fd_set* wr, fd_set* ex, struct timeval* tv)
+	{
+		if(s_bCount) {
+			s_Count.Select++;
+		}
+		return __real_select(nfds, rd, wr, ex, tv);
+	}
+
+	int __wrap_poll(struct pollfd* fds, nfds_t num, int timeout)
+	{
+		if(s_bCount) {
+			s_Count.Select++;
+		}
+		return __real_poll(fds, num, timeout);
+	}
+
+	int __wrap_fsync(int fd)
+	{
+		if(s_bCount) {
+			s_Count.Sync++;
+		}
+		return __real_fsync(fd);
+	}
+
+	int __wrap_tcdrain(int fd)
+	{
+		if(s_bCount) {
+			s_Count.Sync++;
+		}
+		return __real_tcdrain(fd);
+	}
+}
+
+
+namespace SysCount {
+
+void start()
+{
+	s_bCount = true;
+}
+
+void stop()
+{
+	s_bCount = false;
+}
+
+void clear()
+{
+	std::memset(&s_Count, 0, sizeof(s_Count));
+}
+
+const Count& get()
+{
+	return s_Count;
+}
+
+}	//namespace SysCount
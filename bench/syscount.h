@@ -0,0 +1,38 @@
+#ifndef SYSCOUNT_H
+#define SYSCOUNT_H
+
+#include <stdint.h>
+
+/**
+ * @brief	システムコールの回数と転送量
+ *
+ * リンク時に -Wl,--wrap で read/write/writev/select/poll/fsync/tcdrain を差し替えて数える.
+ * 数えるのは #start() を呼んだスレッドの分だけ(ptyの応答スレッドは数えない).
+ */
+namespace SysCount {
+
+	/// @struct	Count
+	/// @brief	回数と転送量
+	struct Count {
+		uint32_t	Read;			///< read()
+		uint32_t	Write;			///< write() / writev()
+		uint32_t	Select;			///< select() / poll()
+		uint32_t	Sync;			///< fsync() / tcdrain()
+		uint32_t	RxBytes;		///< read()したバイト数
+		uint32_t	TxBytes;		///< write() / writev()したバイト数
+
+		/// システムコールの合計
+		uint32_t total() const { return Read + Write + Select + Sync; }
+	};
+
+	/// このスレッドで数え始める
+	void start();
+	/// 数えるのをやめる
+	void stop();
+	/// 0に戻す
+	void clear();
+	/// 今までの値
+	const Count& get();
+}
+
+#endif /* SYSCOUNT_H */
@@ -0,0 +1,74 @@
+/**
+ * @file	writebench.cpp
+ * @brief	DevAccess::WritePolicyごとのコマンド往復時間
+ *
+ * ptyのRC-S620/Sもどきに対してGetFirmwareVersionを繰り返し、
+ * 送信後の待ち方(なし / tcdrain / fsync)による差を測る.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <time.h>
+
+#include "NfcPcd.h"
+#include "devaccess.h"
+#include "ptypcd.h"
+
+namespace {
+	const int LOOP = 2000;
+
+	double now_us()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+	}
+
+	void run(const char* name, DevAccess::WritePolicy policy)
+	{
+		DevAccess::setWritePolicy(policy);
+
+		std::vector<double> lat;
+		lat.reserve(LOOP);
+		int err = 0;
+		for(int i = 0; i < LOOP; i++) {
+			double t = now_us();
+			if(!NfcPcd::getFirmwareVersion(0)) {
+				err++;
+			}
+			lat.push_back(now_us() - t);
+		}
+		std::sort(lat.begin(), lat.end());
+		double sum = 0;
+		for(size_t i = 0; i < lat.size(); i++) {
+			sum += lat[i];
+		}
+		printf("%-8s avg %8.1f us  p50 %8.1f us  p99 %8.1f us  err %d\n",
+				name, sum / lat.size(), lat[lat.size() / 2], lat[lat.size() * 99 / 100], err);
+	}
+}
+
+
+int main()
+{
+	const char* path = PtyPcd::start();
+	if(!path) {
+		return -1;
+	}
+	if(!NfcPcd::portOpen(path)) {
+		printf("open fail\n");
+		PtyPcd::stop();
+		return -1;
+	}
+
+	printf("GetFirmwareVersion x %d (%s)\n", LOOP, path);
+	run("none", DevAccess::WP_NONE);
+	run("tcdrain", DevAccess::WP_DRAIN);
+	run("fsync", DevAccess::WP_FSYNC);
+
+	NfcPcd::portClose();
+	PtyPcd::stop();
+
+	return 0;
+}
@@ -0,0 +1,60 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+#include "HkNfcAsync.h"
+
+namespace {
+	const char* DEVS[] = {
+		"/dev/ttyUSB0",
+		"/dev/ttyUSB1",
+	};
+	const int DEV_NUM = sizeof(DEVS) / sizeof(DEVS[0]);
+
+	//GetFirmwareVersion
+	const uint8_t GETFIRMWARE[] = { 0xd4, 0x02 };
+
+	int s_Remain = 0;
+
+	void fwCb(int port, HkNfcAsync::Result result,
+				const uint8_t* pResponse, uint16_t ResponseLen, void* pUser)
+	{
+		(void)pUser;
+		if((result == HkNfcAsync::RES_OK) && (ResponseLen >= 6)) {
+			printf("[%d] IC:%02x Ver:%02x Rev:%02x\n", port, pResponse[2], pResponse[3], pResponse[4]);
+		} else {
+			printf("[%d] fail : %d\n", port, result);
+		}
+		s_Remain--;
+	}
+}
+
+int nfc_test()
+{
+	HkNfcAsync async;
+	int port[DEV_NUM];
+
+	for(int i=0; i<DEV_NUM; i++) {
+		port[i] = async.open(DEVS[i]);
+		if(port[i] < 0) {
+			std::cout << "open fail : " << DEVS[i] << std::endl;
+			continue;
+		}
+		if(async.submit(port[i], GETFIRMWARE, sizeof(GETFIRMWARE), 1000, fwCb)) {
+			s_Remain++;
+		}
+	}
+
+	// 全部のポートを1スレッドで待つ
+	while(s_Remain > 0) {
+		if(async.dispatch(-1) < 0) {
+			break;
+		}
+	}
+
+	for(int i=0; i<DEV_NUM; i++) {
+		async.close(port[i]);
+	}
+
+	return 0;
+}
@@ -22,8 +22,6 @@ int nfc_test()
 	HkNfcRw::Type type = HkNfcRw::detect(true, true, true);
 	std::cout << "type = " << (int)type << std::endl;
 
-	sleep(1);
-
 	type = HkNfcRw::detect(true, true, true);
 	std::cout << "type = " << (int)type << std::endl;
 
@@ -51,34 +49,38 @@ int nfc_test()
 		std::cout << "FeliCa card." << std::endl;
 	}
 
-	uint8_t buf[16];
+	uint8_t buf[HkNfcF::BLOCK_SIZE * 14];
 
-	for(int blk=0; blk<14; blk++) {
-		bool ret = HkNfcF::read(buf, blk);
-		if(ret) {
+	if(HkNfcF::readBlocks(HkNfcF::SVCCODE_RW, 0, 14, buf)) {
+		for(int blk=0; blk<14; blk++) {
 			for(int i=0; i<16; i++) {
-                printf("%02x ", buf[i]);
+                printf("%02x ", buf[blk * HkNfcF::BLOCK_SIZE + i]);
 			}
             printf("\n");
-		} else {
-			std::cout << "fail : " << blk << std::endl;
-			break;
 		}
+	} else {
+		std::cout << "fail : readBlocks" << std::endl;
 	}
 	std::cout << "----------------------------" << std::endl;
 
-	HkNfcF::setServiceCode(HkNfcF::SVCCODE_RO);
+	// RW:0, RO:0x80-0x88 をまとめて読む
+	HkNfcF::BlockAddr addr[10];
+	addr[0].SvcCode = HkNfcF::SVCCODE_RW;
+	addr[0].BlockNo = 0;
 	for(int blk=0x80; blk<=0x88; blk++) {
-		bool ret = HkNfcF::read(buf, blk);
-		if(ret) {
+		addr[blk - 0x80 + 1].SvcCode = HkNfcF::SVCCODE_RO;
+		addr[blk - 0x80 + 1].BlockNo = blk;
+	}
+	if(HkNfcF::readPlan(addr, 10, buf)) {
+		for(int n=0; n<10; n++) {
+			printf("[%04x:%02x] ", addr[n].SvcCode, addr[n].BlockNo);
 			for(int i=0; i<16; i++) {
-                printf("%02x ", buf[i]);
+                printf("%02x ", buf[n * HkNfcF::BLOCK_SIZE + i]);
 			}
             printf("\n");
-		} else {
-			std::cout << "fail : " << blk << std::endl;
-			break;
 		}
+	} else {
+		std::cout << "fail : readPlan" << std::endl;
 	}
 
 	std::cout << "\nClose" << std::endl;
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+#include "HkNfcPool.h"
+
+namespace {
+	const char* DEVS[] = {
+		"/dev/ttyUSB0",
+		"/dev/ttyUSB1",
+	};
+	const int DEV_NUM = sizeof(DEVS) / sizeof(DEVS[0]);
+
+	const int EVENT_NUM = 10;
+}
+
+int nfc_test()
+{
+	HkNfcPool pool;
+
+	// 遅いリーダーを見つけられるよう、PCDコマンドの統計を10秒ごとに出す
+	pool.setStatInterval(10000);
+	// 読み取り距離の境目でのばたつきを抑え(到着2回/離脱3回)、
+	// カードがない状態が5秒続いたら探索間隔を1秒まで伸ばし、探索の合間は搬送波を止める
+	pool.setHysteresis(2, 3);
+	pool.setPollInterval(50, 1000, 5000);
+	pool.setIdleRfOff(true);
+
+	for(int i=0; i<DEV_NUM; i++) {
+		if(pool.add(DEVS[i]) < 0) {
+			std::cout << "open fail : " << DEVS[i] << std::endl;
+		}
+	}
+
+	// カードの出入りを待つ
+	for(int n=0; n<EVENT_NUM; n++) {
+		HkNfcPool::Event ev;
+		if(!pool.wait(&ev, 10000)) {
+			std::cout << "timeout" << std::endl;
+			break;
+		}
+		printf("[%llu][%d] %s type=%d id=",
+				(unsigned long long)ev.Timestamp, ev.Reader,
+				(ev.EvKind == HkNfcPool::Event::EV_ARRIVED) ? "arrived" : "left",
+				ev.Type);
+		for(int i=0; i<ev.NfcIdLen; i++) {
+			printf("%02x", ev.NfcId[i]);
+		}
+		printf("\n");
+	}
+
+	pool.stop();
+
+	return 0;
+}
@@ -2,6 +2,7 @@
 #define HKNFCA_H
 
 #include <stdint.h>
+#include "HkNfcTls.h"
 
 /**
  * @class		HkNfcA
@@ -48,16 +49,18 @@ private:
 	~HkNfcA();
 
 public:
-	static bool polling();
+	static bool polling(uint8_t MaxTg=1);
 	static bool read(uint8_t* buf, uint8_t blockNo);
 	static bool write(const uint8_t* buf, uint8_t blockNo);
 
 	/// SEL_RES取得
 	static SelRes getSelRes() { return m_SelRes; }
+	/// 選択したカードのSENS_RES/SEL_RESを設定する
+	static void setTargetInfo(uint16_t SensRes, uint8_t SelRes);
 
 private:
-	static uint16_t		m_SensRes;
-	static SelRes		m_SelRes;
+	static HKNFC_TLS uint16_t		m_SensRes;
+	static HKNFC_TLS SelRes		m_SelRes;
 };
 
 
@@ -0,0 +1,152 @@
+#ifndef HKNFC_ASYNC_H
+#define HKNFC_ASYNC_H
+
+#include <stdint.h>
+
+/**
+ * @class		HkNfcAsync
+ * @brief		PCDコマンドの非同期送受信(UART / epoll)
+ * @defgroup	gp_NfcAsync	HkNfcAsyncクラス
+ *
+ * 複数のRC-S620/Sをnon-blockingのfdで開き、1スレッドでまとめて扱う.
+ * コマンドは #submit() で送信し、応答(またはエラー)はコールバックで受け取る.
+ *
+ * #fd() はepollのfdなので、アプリのイベントループにそのまま登録できる.
+ * 読み込み可能になったら #dispatch(0) を呼ぶこと.
+ * 専用スレッドで動かす場合は #dispatch() にタイムアウトを渡して回せばよい.
+ *
+ * コールバックは #dispatch() の中からだけ呼ばれる( #submit() の中で送信に失敗しても、次の #dispatch() で通知する).
+ * リーダーが抜かれるなどしてfdが読み書きできなくなったポートはepollから外し、
+ * 実行中のコマンドを #RES_IOERR で終わらせる. 以降は #isDead() がtrueになるので、 #close() すること.
+ *
+ * @attention	- 1つのポートで同時に実行できるコマンドは1つだけ.
+ * 				  完了コールバックの中から次のコマンドを #submit() したり、 #close() してもよい.
+ * 				- 同期API(HkNfcRw, NfcPcd)とは別のポートを使うこと.
+ */
+class HkNfcAsync {
+public:
+	static const uint8_t PORT_MAX = 16;			///< 扱える最大ポート数
+	static const uint16_t DATA_MAX = 265;		///< コマンド/レスポンスのデータ部最大長
+
+	/// @enum	Result
+	/// @brief	コマンドの結果
+	enum Result {
+		RES_OK,				///< 成功
+		RES_NACK,			///< NACK受信
+		RES_ERRFRAME,		///< Error Frame受信
+		RES_BADFRAME,		///< フレーム異常(LCS/DCS/コマンドコード)
+		RES_TIMEOUT,		///< タイムアウト
+		RES_IOERR			///< 送受信エラー
+	};
+
+	/**
+	 * 完了コールバック
+	 *
+	 * @param[in]	port			ポート番号(#open()の戻り値)
+	 * @param[in]	result			結果
+	 * @param[in]	pResponse		レスポンス(0xd5含む。#RES_OK以外では0)
+	 * @param[in]	ResponseLen		pResponseの長さ
+	 * @param[in]	pUser			#submit()に渡したポインタ
+	 */
+	typedef void (*Callback)(
+			int port, Result result,
+			const uint8_t* pResponse, uint16_t ResponseLen,
+			void* pUser);
+
+public:
+	HkNfcAsync();
+	~HkNfcAsync();
+
+private:
+	HkNfcAsync(const HkNfcAsync&);
+	HkNfcAsync& operator=(const HkNfcAsync&);
+
+
+	/// @addtogroup gp_asyncport	Port
+	/// @ingroup gp_NfcAsync
+	/// @{
+public:
+	/// ポートオープン
+	int open(const char* pPath);
+	/// ポートクローズ
+	void close(int port);
+	/// コマンド実行中かどうか
+	bool isBusy(int port) const;
+	/// 読み書きできなくなったかどうか
+	bool isDead(int port) const;
+	/// @}
+
+
+	/// @addtogroup gp_asynccmd	Command
+	/// @ingroup gp_NfcAsync
+	/// @{
+public:
+	/// コマンド送信
+	bool submit(
+			int port,
+			const uint8_t* pCommand, uint16_t CommandLen,
+			uint16_t Timeout,
+			Callback cb, void* pUser=0);
+	/// 実行中のコマンドを中断する
+	void abort(int port);
+	/// @}
+
+
+	/// @addtogroup gp_asyncloop	Event Loop
+	/// @ingroup gp_NfcAsync
+	/// @{
+public:
+	/// イベントループに登録するfd
+	int fd() const { return m_EpollFd; }
+	/// 次のタイムアウトまでの時間[msec](-1:なし)
+	int nextTimeout() const;
+	/// イベント処理
+	int dispatch(int Timeout=0);
+	/// @}
+
+
+private:
+	/// @enum	State
+	/// @brief	ポートの状態
+	enum State {
+		ST_CLOSED,			///< 未使用
+		ST_IDLE,			///< コマンド待ち
+		ST_SEND,			///< 送信中
+		ST_WAIT_ACK,		///< ACK待ち
+		ST_WAIT_RESP,		///< レスポンス待ち
+		ST_FAILED,			///< 読み書きできなくなった(次の#dispatch()でRES_IOERRを通知する)
+		ST_DEAD				///< 読み書きできなくなった(通知済み)
+	};
+
+	/// @struct	Port
+	/// @brief	ポートごとの状態
+	struct Port {
+		int				Fd;						///< ファイルディスクリプタ
+		State			Stat;					///< 状態
+		uint8_t			CmdCode;				///< 実行中のコマンドコード
+		uint64_t		Deadline;				///< タイムアウト時刻[msec]
+		Callback		Cb;						///< 完了コールバック
+		void*			pUser;					///< コールバックに渡すポインタ
+		uint8_t			TxBuf[DATA_MAX + 10];	///< 送信フレーム
+		uint16_t		TxLen;					///< TxBufの長さ
+		uint16_t		TxPos;					///< 送信済みサイズ
+		uint8_t			RxBuf[DATA_MAX + 10];	///< 受信フレーム
+		uint16_t		RxLen;					///< RxBufの長さ
+	};
+
+private:
+	void onReadable(int port);
+	void onWritable(int port);
+	bool parse(int port);
+	void hangup(int port);
+	void complete(int port, Result result, const uint8_t* pResponse=0, uint16_t ResponseLen=0);
+	void watch(int port, bool bWrite);
+	static uint64_t now();
+
+private:
+	int			m_EpollFd;				///< epollのfd
+	Port		m_Port[PORT_MAX];		///< ポート
+	uint32_t	m_ClosedMask;			///< #dispatch()中に#close()したポート(bit)。そのポートの残りのイベントは捨てる
+};
+
+#endif /* HKNFC_ASYNC_H */
@@ -2,6 +2,7 @@
 #define HKNFCB_H
 
 #include <stdint.h>
+#include "HkNfcTls.h"
 
 /**
  * @class	HkNfcB
@@ -17,7 +18,7 @@ private:
 	~HkNfcB();
 
 public:
-	static bool polling();
+	static bool polling(uint8_t MaxTg=1);
 
 	static bool read(uint8_t* buf, uint8_t blockNo=0x00) { return false; }
 	static bool write(const uint8_t* buf, uint8_t blockNo=0x00) { return false; }
@@ -2,6 +2,7 @@
 #define HK_NFCDEP_H
 
 #include <stdint.h>
+#include "HkNfcTls.h"
 
 /**
  * @class		HkNfcDep
@@ -176,25 +177,25 @@ protected:
 
 
 protected:
-	static DepMode		m_DepMode;			///< 現在のDepMode
-	static bool			m_bInitiator;		///< true:Initiator / false:Target or not DEP mode
+	static HKNFC_TLS DepMode		m_DepMode;			///< 現在のDepMode
+	static HKNFC_TLS bool			m_bInitiator;		///< true:Initiator / false:Target or not DEP mode
 
 protected:
-	static uint16_t		m_LinkTimeout;		///< Link Timeout値[msec](デフォルト:100ms)
-	static bool			m_bSend;			///< true:送信側 / false:受信側
-	static LlcpStatus	m_LlcpStat;			///< LLCP状態
-	static uint8_t		m_DSAP;				///< DSAP
-	static uint8_t		m_SSAP;				///< SSAP
-	static PduType		m_LastSentPdu;		///< 最後に送信したPDU
-	static uint8_t		m_CommandLen;		///< 次に送信するデータ長
-	static uint8_t		m_SendBuf[LLCP_MIU];	///< 送信データバッファ
-	static uint8_t		m_SendLen;				///< 送信データサイズ
-	static uint8_t		m_ValueS;			///< V(S)
-	static uint8_t		m_ValueR;			///< V(R)
-	static uint8_t		m_ValueSA;			///< V(SA)
-	static uint8_t		m_ValueRA;			///< V(SA)
-
-	static void (*m_pRecvCb)(const void* pBuf, uint8_t len);
+	static HKNFC_TLS uint16_t		m_LinkTimeout;		///< Link Timeout値[msec](デフォルト:100ms)
+	static HKNFC_TLS bool			m_bSend;			///< true:送信側 / false:受信側
+	static HKNFC_TLS LlcpStatus	m_LlcpStat;			///< LLCP状態
+	static HKNFC_TLS uint8_t		m_DSAP;				///< DSAP
+	static HKNFC_TLS uint8_t		m_SSAP;				///< SSAP
+	static HKNFC_TLS PduType		m_LastSentPdu;		///< 最後に送信したPDU
+	static HKNFC_TLS uint8_t		m_CommandLen;		///< 次に送信するデータ長
+	static HKNFC_TLS uint8_t		m_SendBuf[LLCP_MIU];	///< 送信データバッファ
+	static HKNFC_TLS uint8_t		m_SendLen;				///< 送信データサイズ
+	static HKNFC_TLS uint8_t		m_ValueS;			///< V(S)
+	static HKNFC_TLS uint8_t		m_ValueR;			///< V(R)
+	static HKNFC_TLS uint8_t		m_ValueSA;			///< V(SA)
+	static HKNFC_TLS uint8_t		m_ValueRA;			///< V(SA)
+
+	static HKNFC_TLS void (*m_pRecvCb)(const void* pBuf, uint8_t len);
 };
 
 #endif /* HK_NFCDEP_H */
@@ -2,6 +2,7 @@
 #define HKNFC_F_H
 
 #include <stdint.h>
+#include "HkNfcTls.h"
 
 /**
  * @class	HkNfcF
@@ -16,18 +17,60 @@ public:
 
 	static const uint16_t SC_NDEF = 0x12fc;			///< NDEFシステムコード
 
+	static const uint8_t BLOCK_SIZE = 16;			///< 1ブロックのサイズ
+	static const uint8_t READ_BLOCK_MAX = 15;		///< 1コマンドで読み込む最大ブロック数
+	static const uint8_t WRITE_BLOCK_MAX = 12;		///< 1コマンドで書き込む最大ブロック数
+	static const uint8_t SERVICE_MAX = 16;			///< 1コマンドで指定できる最大サービス数
+
+	/// @enum	BitRate
+	/// @brief	polling()の通信速度(値はInListPassiveTargetのBrTy)
+	enum BitRate {
+		BR_AUTO	= 0x00,		///< 最後に成功した速度から探す(デフォルト)
+		BR_212K	= 0x01,		///< 212kbps
+		BR_424K	= 0x02		///< 424kbps
+	};
+	/// BR_AUTOで212kbpsを覚えているとき、424kbpsを先に試すpolling()の間隔[回]
+	static const uint8_t PROBE_INTERVAL = 16;
+
+	/// タイムスロットのPollingで一度に応答できる最大カード数
+	static const uint8_t SLOT_NUM = 16;
+
+	/// @struct	Card
+	/// @brief	enumerate()で見つけたカード
+	struct Card {
+		uint8_t			IDm[NFCID_LEN];		///< IDm
+		uint8_t			PMm[8];				///< PMm
+		uint16_t		SystemCode;			///< システムコード
+	};
+
+	/// @struct	BlockAddr
+	/// @brief	readPlan()で読み込むブロック
+	struct BlockAddr {
+		uint16_t		SvcCode;		///< サービスコード
+		uint8_t			BlockNo;		///< ブロック番号
+	};
+
 private:
 	HkNfcF();
 	HkNfcF(const HkNfcF&);
 	~HkNfcF();
 
 public:
-	static bool polling(uint16_t systemCode = 0xffff);
+	static bool polling(uint16_t systemCode = 0xffff, uint8_t MaxTg = 1);
+	static bool isPresent();
+	static void setBitRate(BitRate br);
+	static uint8_t enumerate(Card* pCards, uint8_t Num, uint16_t systemCode = 0xffff);
+	static void select(const Card* pCard);
+	/// 最後にpolling()が成功した通信速度
+	static BitRate bitRate() { return m_BitRate; }
 
 public:
 	static void release();
 	static bool read(uint8_t* buf, uint8_t blockNo=0x00);
+	static bool readBlocks(uint16_t svcCode, uint8_t firstBlock, uint16_t count, uint8_t* buf);
+	static bool readPlan(const BlockAddr* pAddr, uint16_t num, uint8_t* buf);
 	static bool write(const uint8_t* buf, uint8_t blockNo=0x00);
+	static bool writeBlocks(uint16_t svcCode, uint8_t firstBlock, uint16_t count, const uint8_t* buf);
 
 	static void setServiceCode(uint16_t svccode);
 
@@ -42,12 +85,28 @@ public:
 
 
 private:
-	static uint16_t		m_SystemCode;		///< システムコード
-	static uint16_t		m_SvcCode;			///< サービスコード
+	static bool _readWoEnc(
+			const uint16_t* pSvcCode, uint8_t SvcNum,
+			const uint16_t* pBlkList, uint8_t BlkNum,
+			uint8_t* buf, uint16_t* pStatus=0);
+	static bool _writeWoEnc(
+			const uint16_t* pSvcCode, uint8_t SvcNum,
+			const uint16_t* pBlkList, uint8_t BlkNum,
+			const uint8_t* buf, uint16_t* pStatus=0);
+	static bool _shrinkBlockMax(uint16_t status, uint8_t* pBlockMax);
+
+private:
+	static HKNFC_TLS uint16_t		m_SystemCode;		///< システムコード
+	static HKNFC_TLS uint16_t		m_SvcCode;			///< サービスコード
+	static HKNFC_TLS uint8_t		m_ReadBlockMax;		///< カードが受け付けた1コマンドあたりの最大読み込みブロック数
+	static HKNFC_TLS uint8_t		m_WriteBlockMax;	///< カードが受け付けた1コマンドあたりの最大書き込みブロック数
+	static HKNFC_TLS BitRate		m_PinRate;			///< #setBitRate()で固定した通信速度
+	static HKNFC_TLS BitRate		m_BitRate;			///< 最後にpollingが成功した通信速度
+	static HKNFC_TLS uint8_t		m_ProbeCount;		///< 424kbpsを先に試すまでの回数
 
 #ifdef QHKNFCRW_USE_FELICA
-	static uint16_t		m_syscode[16];
-	static uint8_t		m_syscode_num;
+	static HKNFC_TLS uint16_t		m_syscode[16];
+	static HKNFC_TLS uint8_t		m_syscode_num;
 #endif	//QHKNFCRW_USE_FELICA
 };
 
@@ -0,0 +1,185 @@
+#ifndef HKNFC_POOL_H
+#define HKNFC_POOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <cstdio>
+#include "HkNfcRw.h"
+
+/**
+ * @class		HkNfcPool
+ * @brief		複数リーダーのカード検出(リーダーごとのスレッド)
+ * @defgroup	gp_NfcPool	HkNfcPoolクラス
+ *
+ * #add() したリーダーごとにスレッドを起こし、その中で HkNfcRw::open() と
+ * HkNfcRw::detect() を繰り返す. カードがある間は HkNfcRw::isPresent() で済ませる.
+ * カードの到着/離脱はイベントとしてキューに積まれ、アプリは #pop() / #wait() で受け取る.
+ *
+ * リーダーごとに #State の状態を持ち、 #setHysteresis() の回数だけ続けて同じ結果が出たときに
+ * 到着/離脱を確定させる. 読み取り距離の境目でカードが見えたり消えたりしても、イベントを重ねて積まない.
+ * 探索間隔は #setPollInterval() で、カードがある間は短く、ない間は伸ばしていける.
+ * #setIdleRfOff() すると、カードがない間は探索のあとに搬送波を止める.
+ * 探索回数と搬送波を出していた時間は #getStat() で分かる.
+ *
+ * キューは複数のリーダースレッドが書き込み、1つのスレッドが読み出す(MPSC).
+ * 書き込み側はロックを取らない.
+ *
+ * @attention	- #pop() / #wait() は1つのスレッドからだけ呼ぶこと.
+ * 				- リーダースレッドの中のHkNfcRwの状態はそのスレッド専用なので、
+ * 				  アプリのスレッドから HkNfcF::read() などは使えない.
+ * 				- キューが一杯のときのイベントは捨てられる(#dropped()で数が分かる).
+ */
+class HkNfcPool {
+public:
+	static const uint8_t READER_MAX = 8;		///< 扱える最大リーダー数
+	static const uint16_t QUEUE_SIZE = 64;		///< イベントキューのサイズ(2のべき乗)
+	static const uint8_t NFCID_MAX = 12;		///< NFCIDの最大長
+
+	/// @struct	Event
+	/// @brief	カードイベント
+	struct Event {
+		/// @enum	Kind
+		/// @brief	イベントの種類
+		enum Kind {
+			EV_ARRIVED,		///< カード到着
+			EV_LEFT			///< カード離脱
+		};
+
+		Kind			EvKind;					///< 種類
+		int				Reader;					///< リーダー番号(#add()の戻り値)
+		HkNfcRw::Type	Type;					///< カードのNFCタイプ
+		uint8_t			NfcId[NFCID_MAX];		///< NFCID
+		uint8_t			NfcIdLen;				///< NfcIdの長さ
+		uint64_t		Timestamp;				///< 発生時刻[msec](CLOCK_MONOTONIC)
+	};
+
+	/// @enum	State
+	/// @brief	リーダーの状態
+	enum State {
+		ST_ABSENT,			///< カードなし
+		ST_ARRIVING,		///< カードが見えたが、到着は未確定
+		ST_PRESENT,			///< カードあり(到着を通知済み)
+		ST_LEAVING			///< カードが見えなくなったが、離脱は未確定
+	};
+
+	/// @struct	ReaderStat
+	/// @brief	リーダーごとの探索の統計
+	struct ReaderStat {
+		uint32_t		Polls;					///< 探索回数(HkNfcRw::detect()かHkNfcRw::isPresent()の回数)
+		uint64_t		RfOnMsec;				///< 搬送波を出していた時間[msec]
+		uint64_t		ElapsedMsec;			///< リーダースレッドが探索を始めてからの時間[msec]
+	};
+
+public:
+	HkNfcPool();
+	~HkNfcPool();
+
+private:
+	HkNfcPool(const HkNfcPool&);
+	HkNfcPool& operator=(const HkNfcPool&);
+
+
+	/// @addtogroup gp_poolreader	Reader
+	/// @ingroup gp_NfcPool
+	/// @{
+public:
+	/// リーダー追加(スレッド開始)
+	int add(const char* pPath,
+			bool bNfcA=true, bool bNfcB=true, bool bNfcF=true,
+			uint16_t Interval=100);
+	/// 全リーダー停止
+	void stop();
+	/// PCDコマンド統計を出力する間隔[msec]と出力先(0:出さない。#add()より前に設定する)
+	void setStatInterval(uint32_t Interval, FILE* fp=stderr) { m_StatInterval = Interval; m_pStatFile = fp; }
+	/// 探索順を検出実績で入れ替えるかどうか(HkNfcRw::setAdaptiveDetect()参照。#add()より前に設定する)
+	void setAdaptiveDetect(bool bEnable) { m_bAdaptiveDetect = bEnable; }
+	/// 到着/離脱を確定させるまでの連続回数(#add()より前に設定する)
+	void setHysteresis(uint8_t ArriveCount, uint8_t LeaveCount);
+	/// カードがある間とない間の探索間隔(#add()より前に設定する)
+	void setPollInterval(uint16_t PresentInterval, uint16_t IdleIntervalMax, uint32_t IdleBackoffAfter=0);
+	/// カードがない間、探索のあとに搬送波を止めるかどうか(#add()より前に設定する)
+	void setIdleRfOff(bool bEnable) { m_bIdleRfOff = bEnable; }
+	/// リーダーの状態
+	State state(int Reader) const;
+	/// リーダーの探索の統計
+	bool getStat(int Reader, ReaderStat* pStat) const;
+	/// @}
+
+
+	/// @addtogroup gp_poolevent	Event
+	/// @ingroup gp_NfcPool
+	/// @{
+public:
+	/// イベント取り出し
+	bool pop(Event* pEvent);
+	/// イベント待ち
+	bool wait(Event* pEvent, int Timeout=-1);
+	/// イベント通知用fd(pollで読み込み可能になる)
+	int fd() const { return m_EventFd; }
+	/// 捨てたイベント数
+	uint32_t dropped() const { return m_Dropped; }
+	/// @}
+
+
+private:
+	/// @struct	Reader
+	/// @brief	リーダーごとの設定
+	struct Reader {
+		HkNfcPool*		pPool;			///< 所属するプール
+		int				Index;			///< リーダー番号
+		const char*		pPath;			///< デバイスパス
+		bool			bNfcA;			///< NFC-Aを探索する
+		bool			bNfcB;			///< NFC-Bを探索する
+		bool			bNfcF;			///< NFC-Fを探索する
+		uint16_t		Interval;		///< 探索間隔[msec]
+		uint8_t			CurState;		///< 状態(#State。リーダースレッドが書く)
+		uint32_t		Polls;			///< 探索回数(リーダースレッドが書く)
+		uint64_t		RfOnUsec;		///< 搬送波を出していた時間[usec](リーダースレッドが書く)
+		uint64_t		StartTime;		///< 探索を始めた時刻[msec]
+		bool			bRunning;		///< スレッド動作中
+		bool			bOpened;		///< オープン結果
+		pthread_t		Thread;			///< スレッド
+	};
+
+	/// @struct	Cell
+	/// @brief	キューの1要素
+	struct Cell {
+		uint32_t		Seq;			///< 書き込み/読み込み可能かの判定用
+		Event			Ev;				///< イベント
+	};
+
+private:
+	static void* readerMain(void* pArg);
+	void loop(Reader* pReader);
+	static void readStat(const Reader* pReader, ReaderStat* pStat);
+	static void printPollStat(const Reader* pReader, FILE* fp);
+	void printStat(const Reader* pReader);
+	bool sleep(uint16_t msec);
+	void push(const Event& ev);
+	static uint64_t now();
+
+private:
+	Reader				m_Reader[READER_MAX];	///< リーダー
+	int					m_ReaderNum;			///< 使用中のリーダー数
+	volatile bool		m_bStop;				///< 停止要求
+	uint32_t			m_StatInterval;			///< PCDコマンド統計を出力する間隔[msec](0:出さない)
+	FILE*				m_pStatFile;			///< 統計の出力先
+	bool				m_bAdaptiveDetect;		///< 探索順を検出実績で入れ替えるかどうか
+	uint8_t				m_ArriveCount;			///< 到着を確定させる連続検出回数
+	uint8_t				m_LeaveCount;			///< 離脱を確定させる連続未検出回数
+	uint16_t			m_PresentInterval;		///< カードがある間の探索間隔[msec](0:#add()の間隔)
+	uint16_t			m_IdleIntervalMax;		///< カードがない間に伸ばす探索間隔の上限[msec](0:伸ばさない)
+	uint32_t			m_IdleBackoffAfter;		///< カードがなくなってから探索間隔を伸ばし始めるまで[msec]
+	bool				m_bIdleRfOff;			///< カードがない間、探索のあとに搬送波を止める
+
+	pthread_mutex_t		m_Mutex;				///< 起動待ち/停止待ち用
+	pthread_cond_t		m_Cond;					///< 起動待ち/停止待ち用
+
+	Cell				m_Queue[QUEUE_SIZE];	///< イベントキュー
+	uint32_t			m_Head;					///< 次に書き込む位置(書き込み側で共有)
+	uint32_t			m_Tail;					///< 次に読み込む位置(読み込み側専用)
+	uint32_t			m_Dropped;				///< 捨てたイベント数
+	int					m_EventFd;				///< イベント通知用eventfd
+};
+
+#endif /* HKNFC_POOL_H */
@@ -3,11 +3,16 @@
 
 #include <stdint.h>
 #include <cstring>
+#include "HkNfcTls.h"
 
 
 /**
  * @class	HkNfcRw
  * @brief	NFCのR/W(Sony RC-S956系)アクセスクラス
+ *
+ * @attention	状態はスレッドごとに持つ(HkNfcTls.h).
+ * 				1つのスレッドで開けるリーダーは1台だけで、別のスレッドで開いたリーダーは使えない.
+ * 				複数のリーダーを使う場合は、リーダーごとにスレッドを分けて #open() すること.
  */
 class HkNfcRw {
 public:
@@ -22,6 +27,22 @@ public:
         NFC_F			///< NFC-F
 	};
 
+	static const uint8_t TARGET_MAX = 2;		///< #detectAll()で一度に見つける最大カード数
+	static const uint8_t NFCID_MAX = 12;		///< NFCIDの最大長
+
+	/**
+	 * @struct	Target
+	 * @brief	#detectAll()で見つけたカード
+	 */
+	struct Target {
+		Type			NfcType;				///< NFCタイプ
+		uint8_t			Tg;						///< PCDのターゲット番号
+		uint8_t			NfcId[NFCID_MAX];		///< NFCID
+		uint8_t			NfcIdLen;				///< NfcIdの長さ
+		uint16_t		SensRes;				///< SENS_RES(NFC-Aのみ)
+		uint8_t			SelRes;					///< SEL_RES(NFC-Aのみ)
+	};
+
 
 private:
 	HkNfcRw();
@@ -41,7 +62,9 @@ public:
 
 public:
 	/// オープン
-	static bool open();
+	static bool open(const char* pPath=0, uint32_t MaxBaud=0);
+	/// 開き直す(PCDの設定を使い回す)
+	static bool reopen(const char* pPath=0, uint32_t MaxBaud=0);
 	/// クローズ
 	static void close();
 
@@ -51,6 +74,33 @@ public:
 
 	/// ターゲットの探索
 	static Type detect(bool bNfcA, bool bNfcB, bool bNfcF);
+	/// 選択しているカードがまだあるか
+	static bool isPresent();
+	/// 探索順を検出実績で入れ替えるかどうか
+	static void setAdaptiveDetect(bool bEnable);
+	/// 重なったカードをまとめて探索
+	static uint8_t detectAll(bool bNfcA, bool bNfcB, bool bNfcF);
+	/// カード切り替え
+	static bool selectTarget(uint8_t Index);
+
+	/**
+	 * 見つけたカードの数
+	 *
+	 * @return		#detect() / #detectAll() で見つけたカードの数
+	 */
+	static uint8_t getTargetNum() {
+		return m_TargetNum;
+	}
+
+	/**
+	 * 見つけたカード
+	 *
+	 * @param[in]	Index	0～#getTargetNum()-1
+	 * @return		カード(0:Indexが範囲外)
+	 */
+	static const Target* getTarget(uint8_t Index) {
+		return (Index < m_TargetNum) ? &m_Target[Index] : 0;
+	}
 
 	/**
 	 * NFCID取得
@@ -75,7 +125,12 @@ public:
 
 
 private:
-	static Type			m_Type;				///< アクティブなNFCタイプ
+	static Type _detect(bool bNfcA, bool bNfcB, bool bNfcF, uint8_t MaxTg);
+
+private:
+	static HKNFC_TLS Type			m_Type;				///< アクティブなNFCタイプ
+	static HKNFC_TLS Target			m_Target[TARGET_MAX];	///< 見つけたカード
+	static HKNFC_TLS uint8_t		m_TargetNum;		///< m_Targetの数
 };
 
 #endif // QHKNFCRW_H
@@ -2,6 +2,7 @@
 #define HK_NFCSNEP_H
 
 #include <stdint.h>
+#include "HkNfcTls.h"
 #include "HkNfcNdefMsg.h"
 
 class HkNfcSnep {
@@ -52,10 +53,10 @@ private:
 	};
 
 private:
-	static const HkNfcNdefMsg*	m_pMessage;
-	static Mode				m_Mode;
-	static Status			m_Status;
-	static bool (*m_PollFunc)();
+	static HKNFC_TLS const HkNfcNdefMsg*	m_pMessage;
+	static HKNFC_TLS Mode				m_Mode;
+	static HKNFC_TLS Status			m_Status;
+	static HKNFC_TLS bool (*m_PollFunc)();
 };
 
 
@@ -0,0 +1,14 @@
+#ifndef HKNFC_TLS_H
+#define HKNFC_TLS_H
+
+/**
+ * @file	HkNfcTls.h
+ * @brief	リーダーごとの状態の記憶域指定.
+ *
+ * HkNfcRw以下のクラスはstaticメンバで状態を持つが、それらはスレッドごとに別物になる.
+ * 1つのスレッドが1つのリーダー(デバイス+バッファ+カード状態)を受け持つので、
+ * 複数のリーダーを使う場合はリーダーごとにスレッドを分けて HkNfcRw::open(pPath) すること.
+ */
+#define HKNFC_TLS	__thread
+
+#endif /* HKNFC_TLS_H */
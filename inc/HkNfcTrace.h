@@ -0,0 +1,72 @@
+#ifndef HKNFC_TRACE_H
+#define HKNFC_TRACE_H
+
+#include <stdint.h>
+#include <cstdio>
+
+/**
+ * @class		HkNfcTrace
+ * @brief		フレームとイベントのバイナリトレース
+ * @defgroup	gp_NfcTrace	HkNfcTraceクラス
+ *
+ * ライブラリを HKNFCRW_ENABLE_TRACE を定義してビルドすると、PCDとのフレームや
+ * カード検出の結果を固定長レコードのまま全スレッド共通のリングバッファに残す.
+ * 記録は書式化もロックもしないので、RFのループを遅くしない.
+ * 後から #snapshot() で取り出すか、 #print() でテキストにする.
+ *
+ * 定義せずにビルドした場合は何も記録されず、 #snapshot() は常に0を返す.
+ *
+ * @attention	- リングが一周すると古いものから上書きされる.
+ * 				- #print() は作業用の領域を1つしか持たないので、複数スレッドから同時に呼ばないこと.
+ */
+class HkNfcTrace {
+public:
+	static const uint32_t RECORD_NUM = 1024;	///< リングバッファのレコード数(2のべき乗)
+	static const uint8_t DATA_MAX = 44;			///< 1レコードに残すデータの最大長
+
+	/// @enum	Kind
+	/// @brief	レコードの種類
+	enum Kind {
+		TR_TX,			///< PCDへのコマンド(0xd4から)
+		TR_RX,			///< PCDからのレスポンス(0xd5から)
+		TR_ACK,			///< ACK受信
+		TR_NACK,		///< NACK受信
+		TR_NOACK,		///< ACKが来なかった
+		TR_ERRFRAME,	///< Error Frame受信
+		TR_RXERR,		///< レスポンス異常(データは異常の種類)
+		TR_DETECT		///< カード検出の結果(データはNFCタイプ + NFCID)
+	};
+
+	/// @struct	Record
+	/// @brief	トレースの1レコード(64byte)
+	struct Record {
+		uint32_t		Seq;				///< 通し番号+1(0:書き込み中)
+		uint8_t			Kind;				///< 種類(#Kind)
+		uint8_t			Thread;				///< 記録したスレッドの番号(1から)
+		uint16_t		Len;				///< 元のデータ長(DATA_MAXを超えた分は残らない)
+		uint64_t		Usec;				///< 時刻[usec](CLOCK_MONOTONIC)
+		uint8_t			Data[DATA_MAX];		///< データ
+		uint8_t			Reserved[4];		///< 64byteに揃える
+	};
+
+private:
+	HkNfcTrace();
+	HkNfcTrace(const HkNfcTrace&);
+	~HkNfcTrace();
+
+public:
+	/// 記録
+	static void record(Kind kind, const uint8_t* pData, uint16_t len);
+	/// 記録(2つに分かれたデータ)
+	static void record(Kind kind,
+			const uint8_t* pHead, uint16_t HeadLen,
+			const uint8_t* pData, uint16_t DataLen);
+	/// 古い順に取り出す
+	static uint32_t snapshot(Record* pBuf, uint32_t num);
+	/// テキストで出力
+	static void print(FILE* fp);
+	/// 記録を捨てる
+	static void clear();
+};
+
+#endif /* HKNFC_TRACE_H */
@@ -8,8 +8,8 @@
 #include "nfclog.h"
 
 
-uint16_t			HkNfcA::m_SensRes;
-HkNfcA::SelRes		HkNfcA::m_SelRes;
+HKNFC_TLS uint16_t			HkNfcA::m_SensRes;
+HKNFC_TLS HkNfcA::SelRes		HkNfcA::m_SelRes;
 
 
 namespace {
@@ -27,10 +27,14 @@ namespace {
 /**
  * [NFC-A]Polling
  *
+ * @param[in]	MaxTg			取得する最大カード数(NfcPcd::inListPassiveTarget()参照)
+ *
  * @retval		true			成功
  * @retval		false			失敗
+ *
+ * @note		- 複数取得した場合、Tg=1のカードを選択する.
  */
-bool HkNfcA::polling()
+bool HkNfcA::polling(uint8_t MaxTg/*=1*/)
 {
 	int ret;
 	uint8_t responseLen;
@@ -38,11 +42,15 @@ bool HkNfcA::polling()
 
 	ret = NfcPcd::inListPassiveTarget(
 					INLISTPASSIVETARGET, sizeof(INLISTPASSIVETARGET),
-					&pData, &responseLen);
-	if (!ret
-	  || (responseLen < 12)
+					&pData, &responseLen, MaxTg);
+	if(!ret) {
+		//カードがないのは普通なので、探索のたびにログを出さない(PCDの異常はNfcPcdが出す)
+		LOGD("pollingA fail\n");
+		return false;
+	}
+	if((responseLen < 12)
 	  || (responseLen <  7 + *(pData + 7))) {
-		LOGE("pollingA fail: ret=%d/len=%d\n", ret, responseLen);
+		LOGE("pollingA bad response: len=%d\n", responseLen);
 		return false;
 	}
 
@@ -55,10 +63,33 @@ bool HkNfcA::polling()
 		return false;
 	}
 
-	m_SensRes = (uint16_t)((*(pData + 4) << 8) | *(pData + 5));
+	setTargetInfo((uint16_t)((*(pData + 4) << 8) | *(pData + 5)), *(pData + 6));
+
+	if(responseLen <  7 + *(pData + 7)) {
+		LOGE("bad length\n");
+		return false;
+	}
+
+	NfcPcd::setNfcId(pData + 8, *(pData + 7));
+
+	return true;
+}
+
+
+/**
+ * [NFC-A]選択したカードのSENS_RES/SEL_RESを設定する
+ *
+ * #polling()と、HkNfcRw::selectTarget()でカードを切り替えたときに呼ぶ.
+ *
+ * @param[in]	SensRes		SENS_RES
+ * @param[in]	SelRes		SEL_RES(知らない値は#SELRES_UNKNOWNにする)
+ */
+void HkNfcA::setTargetInfo(uint16_t SensRes, uint8_t SelRes)
+{
+	m_SensRes = SensRes;
 	LOGD("SENS_RES:%04x\n", m_SensRes);
 
-	m_SelRes = (SelRes)*(pData + 6);
+	m_SelRes = (HkNfcA::SelRes)SelRes;
 	const char* sel_res;
 	switch(m_SelRes) {
 	case MIFARE_UL:			sel_res = "MIFARE Ultralight";		break;
@@ -73,15 +104,6 @@ bool HkNfcA::polling()
 		sel_res = "???";
 	}
 	LOGD("SEL_RES:%02x(%s)\n", m_SelRes, sel_res);
-
-	if(responseLen <  7 + *(pData + 7)) {
-		LOGE("bad length\n");
-		return false;
-	}
-
-	NfcPcd::setNfcId(pData + 8, *(pData + 7));
-
-	return true;
 }
 
 
@@ -0,0 +1,575 @@
+/**
+ * @file	HkNfcAsync.cpp
+ * @brief	PCDコマンドの非同期送受信実装(UART / epoll).
+ */
+#include <cstring>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/epoll.h>
+
+#include "HkNfcAsync.h"
+
+#define LOG_TAG "HkNfcAsync"
+#include "nfclog.h"
+
+
+namespace {
+	const uint16_t NORMAL_DATA_MAX = 255;	//Normalフレームのデータ部最大
+	const uint16_t DEFAULT_TIMEOUT = 1000;	//タイムアウト省略時[msec]
+	const uint8_t ACK[] = { 0x00, 0x00, 0xff, 0x00, 0xff, 0x00 };
+
+	/**
+	 * 先頭のPreamble/Start Code(00 00 ff)までを捨てる
+	 *
+	 * @return		捨てたあとのサイズ
+	 */
+	uint16_t skip_garbage(uint8_t* buf, uint16_t len)
+	{
+		uint16_t i = 0;
+		while((i + 2 < len) && !((buf[i] == 0x00) && (buf[i+1] == 0x00) && (buf[i+2] == 0xff))) {
+			i++;
+		}
+		if(i) {
+			std::memmove(buf, buf + i, len - i);
+		}
+		return uint16_t(len - i);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+// 実装
+///////////////////////////////////////////////////////////////////////////
+
+HkNfcAsync::HkNfcAsync()
+	: m_ClosedMask(0)
+{
+	m_EpollFd = epoll_create1(EPOLL_CLOEXEC);
+	if(m_EpollFd == -1) {
+		LOGE("epoll_create1 : %s\n", strerror(errno));
+	}
+	for(int i = 0; i < PORT_MAX; i++) {
+		m_Port[i].Fd = -1;
+		m_Port[i].Stat = ST_CLOSED;
+	}
+}
+
+
+HkNfcAsync::~HkNfcAsync()
+{
+	for(int i = 0; i < PORT_MAX; i++) {
+		close(i);
+	}
+	if(m_EpollFd != -1) {
+		::close(m_EpollFd);
+	}
+}
+
+
+/**
+ * ポートオープン
+ *
+ * @param[in]	pPath		デバイスパス(例: "/dev/ttyUSB0")
+ * @return		ポート番号(-1:失敗)
+ *
+ * @note		- 115200bps固定.
+ */
+int HkNfcAsync::open(const char* pPath)
+{
+	int port = 0;
+	while((port < PORT_MAX) && (m_Port[port].Stat != ST_CLOSED)) {
+		port++;
+	}
+	if((port == PORT_MAX) || (m_EpollFd == -1)) {
+		LOGE("open : no port\n");
+		return -1;
+	}
+
+	int fd = ::open(pPath, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if(fd == -1) {
+		LOGE("open fail : %s\n", pPath);
+		return -1;
+	}
+
+	struct termios ter;
+	std::memset(&ter, 0, sizeof(ter));
+	ter.c_iflag = IGNPAR;
+	ter.c_cflag = CLOCAL | CS8 | B115200 | CREAD;
+	tcsetattr(fd, TCSANOW, &ter);
+
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u32 = port;
+	if(epoll_ctl(m_EpollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+		LOGE("epoll_ctl : %s\n", strerror(errno));
+		::close(fd);
+		return -1;
+	}
+
+	Port& p = m_Port[port];
+	p.Fd = fd;
+	p.Stat = ST_IDLE;
+	p.Cb = 0;
+	p.pUser = 0;
+	p.TxLen = 0;
+	p.TxPos = 0;
+	p.RxLen = 0;
+
+	return port;
+}
+
+
+/**
+ * ポートクローズ
+ *
+ * @param[in]	port		ポート番号
+ *
+ * @note		- 実行中のコマンドは中断する(コールバックは呼ばない).
+ */
+void HkNfcAsync::close(int port)
+{
+	if((port < 0) || (port >= PORT_MAX) || (m_Port[port].Stat == ST_CLOSED)) {
+		return;
+	}
+	abort(port);
+	epoll_ctl(m_EpollFd, EPOLL_CTL_DEL, m_Port[port].Fd, 0);
+	::close(m_Port[port].Fd);
+	m_Port[port].Fd = -1;
+	m_Port[port].Stat = ST_CLOSED;
+	m_ClosedMask |= 1U << port;
+}
+
+
+/**
+ * コマンド実行中かどうか
+ *
+ * @param[in]	port		ポート番号
+ * @retval		true		実行中(#submit()できない)
+ */
+bool HkNfcAsync::isBusy(int port) const
+{
+	return (port < 0) || (port >= PORT_MAX) || (m_Port[port].Stat != ST_IDLE);
+}
+
+
+/**
+ * 読み書きできなくなったかどうか
+ *
+ * @param[in]	port		ポート番号
+ * @retval		true		読み書きできない(#close()すること)
+ */
+bool HkNfcAsync::isDead(int port) const
+{
+	return (port >= 0) && (port < PORT_MAX)
+		&& ((m_Port[port].Stat == ST_FAILED) || (m_Port[port].Stat == ST_DEAD));
+}
+
+
+/**
+ * コマンド送信
+ *
+ * フレームを組み立ててすぐに送信を始め、結果はcbで通知する.
+ * cbは #dispatch() の中から呼ばれ、この関数の中では呼ばれない.
+ *
+ * @param[in]	port			ポート番号
+ * @param[in]	pCommand		送信するコマンド(0xd4含む)
+ * @param[in]	CommandLen		pCommandの長さ
+ * @param[in]	Timeout			レスポンスまでのタイムアウト[msec](0:1000ms)
+ * @param[in]	cb				完了コールバック
+ * @param[in]	pUser			cbに渡すポインタ
+ *
+ * @retval		true			受け付けた
+ * @retval		false			受け付けなかった(cbは呼ばれない)
+ */
+bool HkNfcAsync::submit(
+			int port,
+			const uint8_t* pCommand, uint16_t CommandLen,
+			uint16_t Timeout,
+			Callback cb, void* pUser/*=0*/)
+{
+	if(isBusy(port) || (CommandLen < 2) || (CommandLen > DATA_MAX)) {
+		LOGE("submit : port=%d / len=%d\n", port, CommandLen);
+		return false;
+	}
+
+	Port& p = m_Port[port];
+	uint16_t len = 0;
+	p.TxBuf[len++] = 0x00;
+	p.TxBuf[len++] = 0x00;
+	p.TxBuf[len++] = 0xff;
+	if(CommandLen <= NORMAL_DATA_MAX) {
+		// Normalフレーム
+		p.TxBuf[len++] = uint8_t(CommandLen);
+		p.TxBuf[len++] = uint8_t(0 - CommandLen);
+	} else {
+		// Extendedフレーム
+		p.TxBuf[len++] = 0xff;
+		p.TxBuf[len++] = 0xff;
+		p.TxBuf[len++] = uint8_t(CommandLen >> 8);
+		p.TxBuf[len++] = uint8_t(CommandLen);
+		p.TxBuf[len++] = uint8_t(0 - p.TxBuf[5] - p.TxBuf[6]);
+	}
+	uint8_t sum = 0;
+	for(uint16_t i = 0; i < CommandLen; i++) {
+		sum += pCommand[i];
+	}
+	std::memcpy(p.TxBuf + len, pCommand, CommandLen);
+	len += CommandLen;
+	p.TxBuf[len++] = uint8_t(0 - sum);		//DCS
+	p.TxBuf[len++] = 0x00;
+
+	p.TxLen = len;
+	p.TxPos = 0;
+	p.RxLen = 0;
+	p.CmdCode = pCommand[1];
+	p.Cb = cb;
+	p.pUser = pUser;
+	p.Deadline = now() + ((Timeout) ? Timeout : DEFAULT_TIMEOUT);
+	p.Stat = ST_SEND;
+
+	onWritable(port);
+	return true;
+}
+
+
+/**
+ * 実行中のコマンドを中断する
+ *
+ * PCDにACKを送って処理を止め、ポートを #ST_IDLE に戻す.
+ * コールバックは呼ばない.
+ *
+ * @param[in]	port		ポート番号
+ */
+void HkNfcAsync::abort(int port)
+{
+	if((port < 0) || (port >= PORT_MAX)) {
+		return;
+	}
+	Port& p = m_Port[port];
+	if(p.Stat == ST_FAILED) {
+		p.Stat = ST_DEAD;
+		return;
+	}
+	if((p.Stat == ST_CLOSED) || (p.Stat == ST_IDLE) || (p.Stat == ST_DEAD)) {
+		return;
+	}
+	if(p.Stat == ST_SEND) {
+		watch(port, false);
+	}
+	if(::write(p.Fd, ACK, sizeof(ACK)) != sizeof(ACK)) {
+		LOGE("abort : ACK\n");
+	}
+	p.Stat = ST_IDLE;
+	p.RxLen = 0;
+}
+
+
+/**
+ * 次のタイムアウトまでの時間
+ *
+ * @return		時間[msec](-1:実行中のコマンドなし)
+ */
+int HkNfcAsync::nextTimeout() const
+{
+	uint64_t t = now();
+	int ret = -1;
+	for(int i = 0; i < PORT_MAX; i++) {
+		const Port& p = m_Port[i];
+		if((p.Stat == ST_CLOSED) || (p.Stat == ST_IDLE) || (p.Stat == ST_DEAD)) {
+			continue;
+		}
+		int remain = (p.Deadline > t) ? int(p.Deadline - t) : 0;
+		if((ret < 0) || (remain < ret)) {
+			ret = remain;
+		}
+	}
+	return ret;
+}
+
+
+/**
+ * イベント処理
+ *
+ * fdの読み書きとタイムアウトを処理し、完了したコマンドのコールバックを呼ぶ.
+ *
+ * @param[in]	Timeout		待ち時間[msec](0:待たない / -1:イベントがあるまで)
+ * @return		処理したイベント数(-1:エラー)
+ */
+int HkNfcAsync::dispatch(int Timeout/*=0*/)
+{
+	int tmo = nextTimeout();
+	if((tmo < 0) || ((Timeout >= 0) && (Timeout < tmo))) {
+		tmo = Timeout;
+	}
+
+	const int EV_MAX = PORT_MAX;
+	struct epoll_event ev[EV_MAX];
+	int num = epoll_wait(m_EpollFd, ev, EV_MAX, tmo);
+	if(num < 0) {
+		if(errno == EINTR) {
+			return 0;
+		}
+		LOGE("epoll_wait : %s\n", strerror(errno));
+		return -1;
+	}
+
+	//コールバックで閉じたポート(同じ番号で開き直したものも)に、取得済みのイベントを渡さない
+	m_ClosedMask = 0;
+	for(int i = 0; i < num; i++) {
+		int port = int(ev[i].data.u32);
+		if((ev[i].events & EPOLLOUT) && !(m_ClosedMask & (1U << port))) {
+			onWritable(port);
+		}
+		if((ev[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+		  && !(m_ClosedMask & (1U << port)) && !isDead(port)) {
+			onReadable(port);
+		}
+	}
+
+	uint64_t t = now();
+	for(int port = 0; port < PORT_MAX; port++) {
+		const Port& p = m_Port[port];
+		if(p.Stat == ST_FAILED) {
+			m_Port[port].Stat = ST_DEAD;
+			complete(port, RES_IOERR);
+			num++;
+			continue;
+		}
+		if((p.Stat != ST_CLOSED) && (p.Stat != ST_IDLE) && (p.Stat != ST_DEAD) && (p.Deadline <= t)) {
+			LOGE("timeout : port=%d / cmd=%02x\n", port, p.CmdCode);
+			abort(port);
+			complete(port, RES_TIMEOUT);
+			num++;
+		}
+	}
+
+	return num;
+}
+
+
+/**
+ * 送信処理
+ *
+ * 書ききれなかった場合はEPOLLOUTを待って続きを送る.
+ */
+void HkNfcAsync::onWritable(int port)
+{
+	Port& p = m_Port[port];
+	if(p.Stat != ST_SEND) {
+		watch(port, false);
+		return;
+	}
+
+	while(p.TxPos < p.TxLen) {
+		ssize_t sz = ::write(p.Fd, p.TxBuf + p.TxPos, p.TxLen - p.TxPos);
+		if(sz < 0) {
+			if((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				watch(port, true);
+				return;
+			}
+			LOGE("write : %s\n", strerror(errno));
+			hangup(port);
+			return;
+		}
+		p.TxPos += uint16_t(sz);
+	}
+	watch(port, false);
+	p.Stat = ST_WAIT_ACK;
+}
+
+
+/**
+ * 受信処理
+ *
+ * 読めるだけ読み込み、ACKとレスポンスを取り出す.
+ */
+void HkNfcAsync::onReadable(int port)
+{
+	Port& p = m_Port[port];
+	while(true) {
+		if(p.RxLen == sizeof(p.RxBuf)) {
+			//フレームとして大きすぎる
+			abort(port);
+			complete(port, RES_BADFRAME);
+			return;
+		}
+		if(m_ClosedMask & (1U << port)) {
+			//コールバックで閉じられた
+			return;
+		}
+		ssize_t sz = ::read(p.Fd, p.RxBuf + p.RxLen, sizeof(p.RxBuf) - p.RxLen);
+		if(sz < 0) {
+			if((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+				LOGE("read : %s\n", strerror(errno));
+				hangup(port);
+			}
+			return;
+		}
+		if(sz == 0) {
+			//EOF : 切断された
+			LOGE("read : hangup(port=%d)\n", port);
+			hangup(port);
+			return;
+		}
+		if((p.Stat != ST_WAIT_ACK) && (p.Stat != ST_WAIT_RESP)) {
+			//コマンドを送っていないときのデータは捨てる
+			p.RxLen = 0;
+			continue;
+		}
+		p.RxLen += uint16_t(sz);
+		while(parse(port)) {
+			;
+		}
+	}
+}
+
+
+/**
+ * 受信データの解析
+ *
+ * @retval		true		続けて解析できる
+ * @retval		false		データ不足か、コマンド完了
+ */
+bool HkNfcAsync::parse(int port)
+{
+	Port& p = m_Port[port];
+	p.RxLen = skip_garbage(p.RxBuf, p.RxLen);
+
+	if(p.Stat == ST_WAIT_ACK) {
+		if(p.RxLen < sizeof(ACK)) {
+			return false;
+		}
+		if((p.RxBuf[3] == 0x00) && (p.RxBuf[4] == 0xff)) {
+			std::memmove(p.RxBuf, p.RxBuf + sizeof(ACK), p.RxLen - sizeof(ACK));
+			p.RxLen -= sizeof(ACK);
+			p.Stat = ST_WAIT_RESP;
+			return true;
+		}
+		Result result = ((p.RxBuf[3] == 0xff) && (p.RxBuf[4] == 0x00)) ? RES_NACK : RES_BADFRAME;
+		p.Stat = ST_IDLE;
+		p.RxLen = 0;
+		complete(port, result);
+		return false;
+	}
+
+	if(p.Stat != ST_WAIT_RESP) {
+		return false;
+	}
+
+	if(p.RxLen < 5) {
+		return false;
+	}
+	uint16_t pos;
+	uint16_t len;
+	if((p.RxBuf[3] == 0xff) && (p.RxBuf[4] == 0xff)) {
+		// extend frame
+		if(p.RxLen < 8) {
+			return false;
+		}
+		if(((p.RxBuf[5] + p.RxBuf[6] + p.RxBuf[7]) & 0xff) != 0) {
+			abort(port);
+			complete(port, RES_BADFRAME);
+			return false;
+		}
+		len = uint16_t((p.RxBuf[5] << 8) | p.RxBuf[6]);
+		pos = 8;
+	} else {
+		// normal frame
+		if(((p.RxBuf[3] + p.RxBuf[4]) & 0xff) != 0) {
+			abort(port);
+			complete(port, RES_BADFRAME);
+			return false;
+		}
+		len = p.RxBuf[3];
+		pos = 5;
+	}
+	if(size_t(pos + len + 2) > sizeof(p.RxBuf)) {
+		abort(port);
+		complete(port, RES_BADFRAME);
+		return false;
+	}
+	if(p.RxLen < pos + len + 2) {
+		return false;
+	}
+
+	const uint8_t* pData = p.RxBuf + pos;
+	uint8_t sum = 0;
+	for(uint16_t i = 0; i < len; i++) {
+		sum += pData[i];
+	}
+	p.Stat = ST_IDLE;
+	p.RxLen = 0;		//pDataはコールバックが返るまで有効
+	if((len == 1) && (pData[0] == 0x7f)) {
+		complete(port, RES_ERRFRAME);
+	} else if((uint8_t(sum + pData[len]) != 0) || (pData[len + 1] != 0x00)
+	  || (len < 2) || (pData[0] != 0xd5) || (pData[1] != uint8_t(p.CmdCode + 1))) {
+		complete(port, RES_BADFRAME);
+	} else {
+		complete(port, RES_OK, pData, len);
+	}
+
+	return false;
+}
+
+
+/**
+ * 読み書きできなくなったポートを止める
+ *
+ * epollから外して、level-triggeredのEPOLLHUP/EPOLLERRが出続けないようにする.
+ * 実行中のコマンドは、次の #dispatch() で #RES_IOERR を通知する.
+ */
+void HkNfcAsync::hangup(int port)
+{
+	Port& p = m_Port[port];
+	if(p.Stat == ST_CLOSED) {
+		return;
+	}
+	epoll_ctl(m_EpollFd, EPOLL_CTL_DEL, p.Fd, 0);
+	if((p.Stat == ST_SEND) || (p.Stat == ST_WAIT_ACK) || (p.Stat == ST_WAIT_RESP)) {
+		p.Stat = ST_FAILED;
+		p.Deadline = 0;
+	} else {
+		p.Stat = ST_DEAD;
+	}
+	p.RxLen = 0;
+}
+
+
+/**
+ * 完了通知
+ */
+void HkNfcAsync::complete(int port, Result result, const uint8_t* pResponse/*=0*/, uint16_t ResponseLen/*=0*/)
+{
+	Callback cb = m_Port[port].Cb;
+	void* pUser = m_Port[port].pUser;
+	m_Port[port].Cb = 0;
+	if(cb) {
+		(*cb)(port, result, pResponse, ResponseLen, pUser);
+	}
+}
+
+
+/**
+ * EPOLLOUTの監視切り替え
+ */
+void HkNfcAsync::watch(int port, bool bWrite)
+{
+	struct epoll_event ev;
+	ev.events = (bWrite) ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+	ev.data.u32 = port;
+	epoll_ctl(m_EpollFd, EPOLL_CTL_MOD, m_Port[port].Fd, &ev);
+}
+
+
+/**
+ * 現在時刻[msec]
+ */
+uint64_t HkNfcAsync::now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
@@ -16,10 +16,14 @@ namespace {
 /**
  * [NFC-B]Polling
  *
+ * @param[in]	MaxTg			取得する最大カード数(NfcPcd::inListPassiveTarget()参照)
+ *
  * @retval		true			成功
  * @retval		false			失敗
+ *
+ * @note		- 複数取得した場合、Tg=1のカードを選択する.
  */
-bool HkNfcB::polling()
+bool HkNfcB::polling(uint8_t MaxTg/*=1*/)
 {
 	int ret;
 	uint8_t responseLen;
@@ -27,7 +31,7 @@ bool HkNfcB::polling()
 
 	ret = NfcPcd::inListPassiveTarget(
 					INLISTPASSIVETARGET, sizeof(INLISTPASSIVETARGET),
-					&pData, &responseLen);
+					&pData, &responseLen, MaxTg);
 	if (!ret || (responseLen < 17)) {
 		//LOGE("pollingB fail: ret=%d/len=%d\n", ret, responseLen);
 		return false;
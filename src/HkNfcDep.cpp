@@ -14,22 +14,22 @@
 using namespace HkNfcRwMisc;
 
 
-HkNfcDep::DepMode		HkNfcDep::m_DepMode = HkNfcDep::DEP_NONE;
-bool					HkNfcDep::m_bInitiator = false;
-uint16_t				HkNfcDep::m_LinkTimeout;
-bool					HkNfcDep::m_bSend = false;
-HkNfcDep::LlcpStatus	HkNfcDep::m_LlcpStat = HkNfcDep::LSTAT_NONE;
-uint8_t					HkNfcDep::m_DSAP = 0;
-uint8_t					HkNfcDep::m_SSAP = 0;
-HkNfcDep::PduType		HkNfcDep::m_LastSentPdu = HkNfcDep::PDU_NONE;
-uint8_t					HkNfcDep::m_CommandLen = 0;
-uint8_t					HkNfcDep::m_SendBuf[HkNfcDep::LLCP_MIU];
-uint8_t					HkNfcDep::m_SendLen = 0;
-uint8_t	  				HkNfcDep::m_ValueS = 0;
-uint8_t	  				HkNfcDep::m_ValueR = 0;
-uint8_t	  				HkNfcDep::m_ValueSA = 0;
-uint8_t	  				HkNfcDep::m_ValueRA = 0;
-void 					(*HkNfcDep::m_pRecvCb)(const void* pBuf, uint8_t len) = 0;
+HKNFC_TLS HkNfcDep::DepMode		HkNfcDep::m_DepMode = HkNfcDep::DEP_NONE;
+HKNFC_TLS bool					HkNfcDep::m_bInitiator = false;
+HKNFC_TLS uint16_t				HkNfcDep::m_LinkTimeout;
+HKNFC_TLS bool					HkNfcDep::m_bSend = false;
+HKNFC_TLS HkNfcDep::LlcpStatus	HkNfcDep::m_LlcpStat = HkNfcDep::LSTAT_NONE;
+HKNFC_TLS uint8_t					HkNfcDep::m_DSAP = 0;
+HKNFC_TLS uint8_t					HkNfcDep::m_SSAP = 0;
+HKNFC_TLS HkNfcDep::PduType		HkNfcDep::m_LastSentPdu = HkNfcDep::PDU_NONE;
+HKNFC_TLS uint8_t					HkNfcDep::m_CommandLen = 0;
+HKNFC_TLS uint8_t					HkNfcDep::m_SendBuf[HkNfcDep::LLCP_MIU];
+HKNFC_TLS uint8_t					HkNfcDep::m_SendLen = 0;
+HKNFC_TLS uint8_t	  				HkNfcDep::m_ValueS = 0;
+HKNFC_TLS uint8_t	  				HkNfcDep::m_ValueR = 0;
+HKNFC_TLS uint8_t	  				HkNfcDep::m_ValueSA = 0;
+HKNFC_TLS uint8_t	  				HkNfcDep::m_ValueRA = 0;
+HKNFC_TLS void 					(*HkNfcDep::m_pRecvCb)(const void* pBuf, uint8_t len) = 0;
 
 
 namespace {
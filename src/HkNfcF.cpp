@@ -14,15 +14,22 @@ namespace {
 	const uint16_t kSC_BROADCAST = 0xffff;		///<
 	const uint16_t kDEFAULT_TIMEOUT = 1000 * 2;
 	const uint16_t kPUSH_TIMEOUT = 2100 * 2;
+	const uint16_t kENUM_TIMEOUT = 30 * 2;		///< 16スロットのPolling(約23ms)
+	const uint16_t kPRESENCE_TIMEOUT = 10 * 2;	///< Request Response
 }
 
 
-uint16_t		HkNfcF::m_SystemCode = kSC_BROADCAST;		///< システムコード
-uint16_t		HkNfcF::m_SvcCode = SVCCODE_RW;
+HKNFC_TLS uint16_t		HkNfcF::m_SystemCode = kSC_BROADCAST;		///< システムコード
+HKNFC_TLS uint16_t		HkNfcF::m_SvcCode = SVCCODE_RW;
+HKNFC_TLS uint8_t			HkNfcF::m_ReadBlockMax = HkNfcF::READ_BLOCK_MAX;
+HKNFC_TLS uint8_t			HkNfcF::m_WriteBlockMax = HkNfcF::WRITE_BLOCK_MAX;
+HKNFC_TLS HkNfcF::BitRate	HkNfcF::m_PinRate = HkNfcF::BR_AUTO;
+HKNFC_TLS HkNfcF::BitRate	HkNfcF::m_BitRate = HkNfcF::BR_424K;
+HKNFC_TLS uint8_t			HkNfcF::m_ProbeCount = 0;
 
 #ifdef QHKNFCRW_USE_FELICA
-uint16_t		HkNfcF::m_syscode[16];
-uint8_t			HkNfcF::m_syscode_num;
+HKNFC_TLS uint16_t		HkNfcF::m_syscode[16];
+HKNFC_TLS uint8_t			HkNfcF::m_syscode_num;
 #endif	//QHKNFCRW_USE_FELICA
 
 
@@ -34,10 +41,19 @@ namespace {
 	enum SCOrderType {
 		SCO_NORMAL = 0x00,
 	};
-	inline uint16_t create_blocklist2(uint16_t blockNo, AccessModeType am=AM_NORMAL, SCOrderType sco=SCO_NORMAL)
+	inline uint16_t create_blocklist2(uint16_t blockNo, AccessModeType am=AM_NORMAL, uint8_t sco=SCO_NORMAL)
 	{
 		return uint16_t(0x8000U | (am << 12) | (sco << 8) | blockNo);
 	}
+
+	const uint8_t kSTATUS2_SVCNUM = 0xa1;		///< Status Flag2:サービス数エラー
+	const uint8_t kSTATUS2_BLOCKNUM = 0xa2;		///< Status Flag2:ブロック数エラー
+
+	/// ブロック数を減らせば通るかもしれないStatus Flag2か
+	inline bool _isBlockNumError(uint8_t status2)
+	{
+		return (status2 == kSTATUS2_BLOCKNUM) || (status2 == kSTATUS2_SVCNUM);
+	}
 }
 
 
@@ -47,6 +63,8 @@ namespace {
 void HkNfcF::release()
 {
 	m_SystemCode = kSC_BROADCAST;
+	m_ReadBlockMax = READ_BLOCK_MAX;
+	m_WriteBlockMax = WRITE_BLOCK_MAX;
 }
 
 
@@ -54,6 +72,7 @@ void HkNfcF::release()
  * Polling
  *
  * @param[in]		systemCode		システムコード
+ * @param[in]		MaxTg			取得する最大カード数(NfcPcd::inListPassiveTarget()参照)
  * @retval			true			取得成功
  * @retval			false			取得失敗
  *
@@ -61,8 +80,11 @@ void HkNfcF::release()
  * @retval		false			失敗
  *
  * @attention	- 取得失敗は、主にカードが認識できない場合である。
+ *
+ * @note		- 通信速度は#setBitRate()参照。
+ * 				- 複数取得した場合、Tg=1のカードを選択する。
  */
-bool HkNfcF::polling(uint16_t systemCode /* = 0xffff */)
+bool HkNfcF::polling(uint16_t systemCode /* = 0xffff */, uint8_t MaxTg /* = 1 */)
 {
 	//InListPassiveTarget
 	const uint8_t INLISTPASSIVETARGET[] = {
@@ -78,34 +100,56 @@ bool HkNfcF::polling(uint16_t systemCode /* = 0xffff */)
 		0x01				// response code
 	};
 
-	bool ret;
+	bool ret = false;
 	uint8_t responseLen = 0;
 	uint8_t* pData;
 
-	// 424Kbps
+	//試す通信速度
+	BitRate rate[2];
+	uint8_t rate_num = 1;
+	if(m_PinRate != BR_AUTO) {
+		rate[0] = m_PinRate;
+	} else {
+		rate[0] = m_BitRate;
+		if(m_BitRate == BR_212K) {
+			//424kbpsに応答するカードに変わっていないか、ときどき先に試す
+			if(++m_ProbeCount >= PROBE_INTERVAL) {
+				m_ProbeCount = 0;
+				rate[0] = BR_424K;
+			}
+		}
+		rate[1] = (rate[0] == BR_424K) ? BR_212K : BR_424K;
+		rate_num = 2;
+	}
+
 	memcpy(NfcPcd::commandBuf(), INLISTPASSIVETARGET, sizeof(INLISTPASSIVETARGET));
 	NfcPcd::commandBuf(2) = h16(systemCode);
 	NfcPcd::commandBuf(3) = l16(systemCode);
 
-	ret = NfcPcd::inListPassiveTarget(
-				NfcPcd::commandBuf(), sizeof(INLISTPASSIVETARGET),
-				&pData, &responseLen);
-	if (!ret
-	  || (memcmp(&pData[3], INLISTPASSIVETARGET_RES, sizeof(INLISTPASSIVETARGET_RES)) != 0)) {
-		LOGE("pollingF fail(424Kbps): ret=%d/len=%d\n", ret, responseLen);
-
-		//212Kbps
-		NfcPcd::commandBuf(0) = 0x01;
+	for(uint8_t i = 0; i < rate_num; i++) {
+		NfcPcd::commandBuf(0) = (uint8_t)rate[i];
 		ret = NfcPcd::inListPassiveTarget(
-				NfcPcd::commandBuf(), sizeof(INLISTPASSIVETARGET),
-				&pData, &responseLen);
-		if (!ret
-		  || (memcmp(&pData[3], INLISTPASSIVETARGET_RES, sizeof(INLISTPASSIVETARGET_RES)) != 0)) {
-			LOGE("pollingF fail(212Kbps): ret=%d/len=%d\n", ret, responseLen);
-			m_SystemCode = kSC_BROADCAST;
-			return false;
+					NfcPcd::commandBuf(), sizeof(INLISTPASSIVETARGET),
+					&pData, &responseLen, MaxTg);
+		if (ret
+		  && (memcmp(&pData[3], INLISTPASSIVETARGET_RES, sizeof(INLISTPASSIVETARGET_RES)) == 0)) {
+			m_BitRate = rate[i];
+			break;
+		}
+		if(ret) {
+			LOGE("pollingF bad response(%dKbps): len=%d\n", (rate[i] == BR_424K) ? 424 : 212, responseLen);
+		} else {
+			//カードがないのは普通なので、探索のたびにログを出さない(PCDの異常はNfcPcdが出す)
+			LOGD("pollingF fail(%dKbps)\n", (rate[i] == BR_424K) ? 424 : 212);
 		}
+		ret = false;
+	}
+	if(!ret) {
+		m_SystemCode = kSC_BROADCAST;
+		return false;
 	}
+	m_ReadBlockMax = READ_BLOCK_MAX;
+	m_WriteBlockMax = WRITE_BLOCK_MAX;
 	//[0] d5
 	//[1] 4b
 	//[2] NbTg
@@ -119,45 +163,483 @@ bool HkNfcF::polling(uint16_t systemCode /* = 0xffff */)
 
 
 /**
+ * pollingしたカードがまだあるか
+ *
+ * 保持しているIDmにRequest Responseを送り、応答があるかで判断する.
+ * Pollingをやり直さないので、polling()より短い時間で済む.
+ *
+ * @retval		true			応答あり
+ * @retval		false			応答なし(カードがなくなった)
+ */
+bool HkNfcF::isPresent()
+{
+	if(NfcPcd::nfcIdLen() != NFCID_LEN) {
+		return false;
+	}
+
+	NfcPcd::commandBuf(0) = 10;
+	NfcPcd::commandBuf(1) = 0x04;				//Request Response
+	memcpy(NfcPcd::commandBuf() + 2, NfcPcd::nfcId(), NFCID_LEN);
+
+	uint8_t res_len = 0;
+	bool ret = NfcPcd::communicateThruEx(
+					kPRESENCE_TIMEOUT,
+					NfcPcd::commandBuf(), 10,
+					NfcPcd::responseBuf(), &res_len);
+	//[0]05 [1-8]IDm [9]Mode
+	return ret && (res_len >= 10) && (NfcPcd::responseBuf(0) == 0x05)
+		&& (memcmp(NfcPcd::responseBuf() + 1, NfcPcd::nfcId(), NFCID_LEN) == 0);
+}
+
+
+/**
+ * タイムスロットのPollingで、応答したカードを全部取得する
+ *
+ * Time Slot 0x0f(16スロット)のPollingを1回だけCommunicateThruExで送り、
+ * 各スロットのPolling応答(IDm, PMm, システムコード)を集める.
+ * 応答したスロットの順はカードしだいなので、IDmの昇順に並べて返す.
+ *
+ * @param[out]	pCards		取得したカード(IDm昇順)
+ * @param[in]	Num			pCardsの数
+ * @param[in]	systemCode	システムコード
+ * @return		取得したカード数(0:応答なし)
+ *
+ * @note		- 同じスロットで応答したカードは衝突して届かないので、取りこぼすことがある.
+ * 				  全部取れたか確かめたいときは、数が変わらなくなるまで繰り返すこと.
+ * 				- 取得しただけではカードを選択しない. 操作するカードは#select()で選ぶ.
+ * 				- 1回のレスポンスはNfcPcd::DATA_MAXまでなので、13枚を超える分は届かない.
+ */
+uint8_t HkNfcF::enumerate(Card* pCards, uint8_t Num, uint16_t systemCode /* = 0xffff */)
+{
+	NfcPcd::commandBuf(0) = 6;
+	NfcPcd::commandBuf(1) = 0x00;				//Polling
+	NfcPcd::commandBuf(2) = h16(systemCode);
+	NfcPcd::commandBuf(3) = l16(systemCode);
+	NfcPcd::commandBuf(4) = 0x01;				//システムコード要求
+	NfcPcd::commandBuf(5) = SLOT_NUM - 1;		//Time Slot
+
+	uint16_t res_len;
+	bool ret = NfcPcd::communicateThruExAll(
+					kENUM_TIMEOUT,
+					NfcPcd::commandBuf(), 6,
+					NfcPcd::responseBuf(), &res_len);
+	if(!ret) {
+		return 0;
+	}
+
+	//[0]LEN [1]01 [2-9]IDm [10-17]PMm [18-19]システムコード
+	uint8_t num = 0;
+	uint16_t pos = 0;
+	while((pos < res_len) && (num < Num)) {
+		const uint8_t* p = NfcPcd::responseBuf() + pos;
+		uint8_t len = p[0];
+		if((len < 18) || (pos + len > res_len) || (p[1] != 0x01)) {
+			LOGE("enumerate : bad response(%d)\n", pos);
+			break;
+		}
+		pos += len;
+
+		//IDmの昇順に挿入(同じIDmは捨てる)
+		uint8_t i = 0;
+		int cmp = 1;
+		while((i < num) && ((cmp = memcmp(pCards[i].IDm, p + 2, NFCID_LEN)) < 0)) {
+			i++;
+		}
+		if((i < num) && (cmp == 0)) {
+			continue;
+		}
+		memmove(&pCards[i + 1], &pCards[i], (num - i) * sizeof(Card));
+		memcpy(pCards[i].IDm, p + 2, NFCID_LEN);
+		memcpy(pCards[i].PMm, p + 10, sizeof(pCards[i].PMm));
+		pCards[i].SystemCode = (len >= 20) ? hl16(p[18], p[19]) : systemCode;
+		num++;
+	}
+
+	return num;
+}
+
+
+/**
+ * enumerate()で取得したカードを選択する
+ *
+ * 以降のread()/write()などの相手にする.
+ *
+ * @param[in]	pCard		カード
+ */
+void HkNfcF::select(const Card* pCard)
+{
+	NfcPcd::setNfcId(pCard->IDm, NFCID_LEN);
+	m_SystemCode = pCard->SystemCode;
+	m_ReadBlockMax = READ_BLOCK_MAX;
+	m_WriteBlockMax = WRITE_BLOCK_MAX;
+}
+
+
+/**
+ * polling()の通信速度設定
+ *
+ * BR_AUTOでは、最後に成功した速度から試し、だめならもう一方を試す.
+ * 212kbpsを覚えている間も、#PROBE_INTERVAL回に1回は424kbpsから試す.
+ * 覚えた速度はスレッド(リーダー)ごと.
+ *
+ * @param[in]	br		BR_AUTO(デフォルト) / BR_212K, BR_424K:その速度だけ使う
+ */
+void HkNfcF::setBitRate(BitRate br)
+{
+	m_PinRate = br;
+	m_ProbeCount = 0;
+}
+
+
+/**
+ * Read Without Encryption(1ブロック)
  *
+ * @param[out]	buf			読み込みデータ(16byte)
+ * @param[in]	blockNo		ブロック番号
+ *
+ * @retval		true			成功
+ * @retval		false			失敗
+ *
+ * @note		- サービスコードは #setServiceCode() で設定したものを使う.
  */
 bool HkNfcF::read(uint8_t* buf, uint8_t blockNo/*=0x00*/)
 {
-	uint8_t len;
-	NfcPcd::commandBuf(0) = 16;
-	NfcPcd::commandBuf(1) = 0x06;	// Read w/o Enc.
-	memcpy(NfcPcd::commandBuf() + 2, NfcPcd::nfcId(), NfcPcd::NFCID2_LEN);
-	NfcPcd::commandBuf(10) = 0x01;				//サービス数
-	NfcPcd::commandBuf(11) = l16(m_SvcCode);
-	NfcPcd::commandBuf(12) = h16(m_SvcCode);
-	NfcPcd::commandBuf(13) = 0x01;			//ブロック数
 	uint16_t blist = create_blocklist2(blockNo);
-	NfcPcd::commandBuf(14) = h16(blist);
-	NfcPcd::commandBuf(15) = l16(blist);
+	return _readWoEnc(&m_SvcCode, 1, &blist, 1, buf);
+}
+
+
+/**
+ * Read Without Encryption(連続ブロック)
+ *
+ * firstBlockからcount個のブロックを読み込む.
+ * 1コマンドに最大 #READ_BLOCK_MAX ブロックまで詰め込み、
+ * それを超える場合は最小回数のコマンドに分割する.
+ *
+ * @param[in]	svcCode		サービスコード
+ * @param[in]	firstBlock	先頭ブロック番号
+ * @param[in]	count		読み込むブロック数
+ * @param[out]	buf			読み込みデータ(16 x count byte)
+ *
+ * @retval		true			成功
+ * @retval		false			失敗
+ *
+ * @note		- カードがブロック数エラー(またはサービス数エラー)を返した場合は1コマンドあたりのブロック数を
+ * 				  半分にして再送し、次のpollingまでその値を使う.
+ */
+bool HkNfcF::readBlocks(uint16_t svcCode, uint8_t firstBlock, uint16_t count, uint8_t* buf)
+{
+	if(firstBlock + count > 0x100) {
+		LOGE("readBlocks : bad range(%d + %d)\n", firstBlock, count);
+		return false;
+	}
+
+	uint16_t blist[READ_BLOCK_MAX];
+	uint16_t blk = firstBlock;
+	while(count) {
+		uint8_t num = (count < m_ReadBlockMax) ? uint8_t(count) : m_ReadBlockMax;
+		for(uint8_t i = 0; i < num; i++) {
+			blist[i] = create_blocklist2(uint16_t(blk + i));
+		}
+
+		uint16_t status = 0;
+		bool ret = _readWoEnc(&svcCode, 1, blist, num, buf, &status);
+		if(!ret) {
+			if(_shrinkBlockMax(status, &m_ReadBlockMax)) {
+				continue;
+			}
+			return false;
+		}
+		buf += num * BLOCK_SIZE;
+		blk += num;
+		count -= num;
+	}
+
+	return true;
+}
+
+
+/**
+ * Read Without Encryption(複数サービス・複数ブロック)
+ *
+ * pAddrで指定した(サービスコード, ブロック番号)の組を先頭から順に
+ * 1コマンドあたり最大 #READ_BLOCK_MAX ブロック・#SERVICE_MAX サービスまでまとめ、
+ * 最小回数のコマンドで読み込む.
+ * 同じサービスコードはサービスコードリストに1回だけ載せる.
+ *
+ * @param[in]	pAddr		読み込むブロックのリスト
+ * @param[in]	num			pAddrの数
+ * @param[out]	buf			読み込みデータ(16 x num byte, pAddrと同じ順)
+ *
+ * @retval		true			成功
+ * @retval		false			失敗
+ *
+ * @note		- ブロック数エラー/サービス数エラーの扱いは #readBlocks() と同じ.
+ */
+bool HkNfcF::readPlan(const BlockAddr* pAddr, uint16_t num, uint8_t* buf)
+{
+	uint16_t svclist[SERVICE_MAX];
+	uint16_t blist[READ_BLOCK_MAX];
+
+	while(num) {
+		uint8_t svc_num = 0;
+		uint8_t blk_num = 0;
+		while((blk_num < num) && (blk_num < m_ReadBlockMax)) {
+			uint16_t svc = pAddr[blk_num].SvcCode;
+			uint8_t sco = 0;
+			while((sco < svc_num) && (svclist[sco] != svc)) {
+				sco++;
+			}
+			if(sco == svc_num) {
+				if(svc_num == SERVICE_MAX) {
+					break;
+				}
+				svclist[svc_num++] = svc;
+			}
+			blist[blk_num] = create_blocklist2(pAddr[blk_num].BlockNo, AM_NORMAL, sco);
+			blk_num++;
+		}
+
+		uint16_t status = 0;
+		bool ret = _readWoEnc(svclist, svc_num, blist, blk_num, buf, &status);
+		if(!ret) {
+			if(_shrinkBlockMax(status, &m_ReadBlockMax)) {
+				continue;
+			}
+			return false;
+		}
+		buf += blk_num * BLOCK_SIZE;
+		pAddr += blk_num;
+		num -= blk_num;
+	}
+
+	return true;
+}
+
+
+/**
+ * 1コマンドあたりのブロック数を減らす
+ *
+ * @param[in]		status		_readWoEnc()/_writeWoEnc()で取得したStatus Flag
+ * @param[in,out]	pBlockMax	1コマンドあたりの最大ブロック数
+ *
+ * @retval		true			減らした(再送すること)
+ * @retval		false			減らせない(エラー)
+ */
+bool HkNfcF::_shrinkBlockMax(uint16_t status, uint8_t* pBlockMax)
+{
+	if(!_isBlockNumError(l16(status)) || (*pBlockMax <= 1)) {
+		return false;
+	}
+	*pBlockMax /= 2;
+	LOGD("block max -> %d\n", *pBlockMax);
+	NfcPcd::countRetry();
+	return true;
+}
+
+
+/**
+ * Read Without Encryption送信
+ *
+ * @param[in]	pSvcCode	サービスコードリスト
+ * @param[in]	SvcNum		pSvcCodeの数
+ * @param[in]	pBlkList	ブロックリスト(2byte形式)
+ * @param[in]	BlkNum		pBlkListの数
+ * @param[out]	buf			読み込みデータ(16 x BlkNum byte)
+ * @param[out]	pStatus		Status Flag1(上位) / Status Flag2(下位)(不要なら0)
+ *
+ * @retval		true			成功
+ * @retval		false			失敗
+ */
+bool HkNfcF::_readWoEnc(
+			const uint16_t* pSvcCode, uint8_t SvcNum,
+			const uint16_t* pBlkList, uint8_t BlkNum,
+			uint8_t* buf, uint16_t* pStatus/*=0*/)
+{
+	if(pStatus) {
+		*pStatus = 0xffff;
+	}
+
+	uint8_t len = 0;
+	NfcPcd::commandBuf(len++) = 0;	//あとで設定
+	NfcPcd::commandBuf(len++) = 0x06;	// Read w/o Enc.
+	memcpy(NfcPcd::commandBuf() + len, NfcPcd::nfcId(), NfcPcd::NFCID2_LEN);
+	len += NfcPcd::NFCID2_LEN;
+	NfcPcd::commandBuf(len++) = SvcNum;				//サービス数
+	for(uint8_t i = 0; i < SvcNum; i++) {
+		NfcPcd::commandBuf(len++) = l16(pSvcCode[i]);
+		NfcPcd::commandBuf(len++) = h16(pSvcCode[i]);
+	}
+	NfcPcd::commandBuf(len++) = BlkNum;				//ブロック数
+	for(uint8_t i = 0; i < BlkNum; i++) {
+		NfcPcd::commandBuf(len++) = h16(pBlkList[i]);
+		NfcPcd::commandBuf(len++) = l16(pBlkList[i]);
+	}
+	NfcPcd::commandBuf(0) = len;
+
+	uint8_t res_len = 0;
 	bool ret = NfcPcd::communicateThruEx(
 					kDEFAULT_TIMEOUT,
-					NfcPcd::commandBuf(), 16,
-					NfcPcd::responseBuf(), &len);
-	if (!ret || (NfcPcd::responseBuf(0) != 0x07)
-	  || (memcmp(NfcPcd::responseBuf() + 1, NfcPcd::nfcId(), NfcPcd::NFCID2_LEN) != 0)
-	  || (NfcPcd::responseBuf(9) != 0x00)
-	  || (NfcPcd::responseBuf(10) != 0x00)) {
-		LOGE("read : ret=%d / %02x / %02x / %02x\n", ret, NfcPcd::responseBuf(0), NfcPcd::responseBuf(9), NfcPcd::responseBuf(10));
+					NfcPcd::commandBuf(), len,
+					NfcPcd::responseBuf(), &res_len);
+	if (!ret || (res_len < 11) || (NfcPcd::responseBuf(0) != 0x07)
+	  || (memcmp(NfcPcd::responseBuf() + 1, NfcPcd::nfcId(), NfcPcd::NFCID2_LEN) != 0)) {
+		LOGE("read : ret=%d / len=%d / %02x\n", ret, res_len, NfcPcd::responseBuf(0));
+		return false;
+	}
+	if(pStatus) {
+		*pStatus = hl16(NfcPcd::responseBuf(9), NfcPcd::responseBuf(10));
+	}
+	if((NfcPcd::responseBuf(9) != 0x00) || (NfcPcd::responseBuf(10) != 0x00)
+	  || (NfcPcd::responseBuf(11) != BlkNum)
+	  || (res_len != 12 + BlkNum * BLOCK_SIZE)) {
+		if(_isBlockNumError(NfcPcd::responseBuf(10))) {
+			//ブロック数を減らして送り直すので、エラーにしない
+			LOGD("read : %02x / %02x / %d\n", NfcPcd::responseBuf(9), NfcPcd::responseBuf(10), res_len);
+		} else {
+			LOGE("read : %02x / %02x / %d\n", NfcPcd::responseBuf(9), NfcPcd::responseBuf(10), res_len);
+		}
 		return false;
 	}
-	//NfcPcd::responseBuf(11) == 0x01
-	memcpy(buf, &NfcPcd::responseBuf(12), 16);
+	memcpy(buf, &NfcPcd::responseBuf(12), BlkNum * BLOCK_SIZE);
 
 	return true;
 }
 
 
 /**
+ * Write Without Encryption(1ブロック)
+ *
+ * @param[in]	buf			書き込みデータ(16byte)
+ * @param[in]	blockNo		ブロック番号
+ *
+ * @retval		true			成功
+ * @retval		false			失敗
  *
+ * @note		- サービスコードは #setServiceCode() で設定したものを使う.
  */
 bool HkNfcF::write(const uint8_t* buf, uint8_t blockNo/*=0x00*/)
 {
-	return false;
+	uint16_t blist = create_blocklist2(blockNo);
+	return _writeWoEnc(&m_SvcCode, 1, &blist, 1, buf);
+}
+
+
+/**
+ * Write Without Encryption(連続ブロック)
+ *
+ * firstBlockからcount個のブロックに書き込む.
+ * 1コマンドに最大 #WRITE_BLOCK_MAX ブロックまで詰め込み、
+ * それを超える場合は最小回数のコマンドに分割する.
+ *
+ * @param[in]	svcCode		サービスコード
+ * @param[in]	firstBlock	先頭ブロック番号
+ * @param[in]	count		書き込むブロック数
+ * @param[in]	buf			書き込みデータ(16 x count byte)
+ *
+ * @retval		true			成功
+ * @retval		false			失敗
+ *
+ * @note		- ブロック数エラーの扱いは #readBlocks() と同じ.
+ * @attention	- 途中のコマンドで失敗した場合、それより前のブロックは書き込まれている.
+ */
+bool HkNfcF::writeBlocks(uint16_t svcCode, uint8_t firstBlock, uint16_t count, const uint8_t* buf)
+{
+	if(firstBlock + count > 0x100) {
+		LOGE("writeBlocks : bad range(%d + %d)\n", firstBlock, count);
+		return false;
+	}
+
+	uint16_t blist[WRITE_BLOCK_MAX];
+	uint16_t blk = firstBlock;
+	while(count) {
+		uint8_t num = (count < m_WriteBlockMax) ? uint8_t(count) : m_WriteBlockMax;
+		for(uint8_t i = 0; i < num; i++) {
+			blist[i] = create_blocklist2(uint16_t(blk + i));
+		}
+
+		uint16_t status = 0;
+		bool ret = _writeWoEnc(&svcCode, 1, blist, num, buf, &status);
+		if(!ret) {
+			if(_shrinkBlockMax(status, &m_WriteBlockMax)) {
+				continue;
+			}
+			return false;
+		}
+		buf += num * BLOCK_SIZE;
+		blk += num;
+		count -= num;
+	}
+
+	return true;
+}
+
+
+/**
+ * Write Without Encryption送信
+ *
+ * @param[in]	pSvcCode	サービスコードリスト
+ * @param[in]	SvcNum		pSvcCodeの数
+ * @param[in]	pBlkList	ブロックリスト(2byte形式)
+ * @param[in]	BlkNum		pBlkListの数
+ * @param[in]	buf			書き込みデータ(16 x BlkNum byte)
+ * @param[out]	pStatus		Status Flag1(上位) / Status Flag2(下位)(不要なら0)
+ *
+ * @retval		true			成功
+ * @retval		false			失敗
+ */
+bool HkNfcF::_writeWoEnc(
+			const uint16_t* pSvcCode, uint8_t SvcNum,
+			const uint16_t* pBlkList, uint8_t BlkNum,
+			const uint8_t* buf, uint16_t* pStatus/*=0*/)
+{
+	if(pStatus) {
+		*pStatus = 0xffff;
+	}
+
+	uint8_t len = 0;
+	NfcPcd::commandBuf(len++) = 0;	//あとで設定
+	NfcPcd::commandBuf(len++) = 0x08;	// Write w/o Enc.
+	memcpy(NfcPcd::commandBuf() + len, NfcPcd::nfcId(), NfcPcd::NFCID2_LEN);
+	len += NfcPcd::NFCID2_LEN;
+	NfcPcd::commandBuf(len++) = SvcNum;				//サービス数
+	for(uint8_t i = 0; i < SvcNum; i++) {
+		NfcPcd::commandBuf(len++) = l16(pSvcCode[i]);
+		NfcPcd::commandBuf(len++) = h16(pSvcCode[i]);
+	}
+	NfcPcd::commandBuf(len++) = BlkNum;				//ブロック数
+	for(uint8_t i = 0; i < BlkNum; i++) {
+		NfcPcd::commandBuf(len++) = h16(pBlkList[i]);
+		NfcPcd::commandBuf(len++) = l16(pBlkList[i]);
+	}
+	memcpy(NfcPcd::commandBuf() + len, buf, BlkNum * BLOCK_SIZE);
+	len += BlkNum * BLOCK_SIZE;
+	NfcPcd::commandBuf(0) = len;
+
+	uint8_t res_len = 0;
+	bool ret = NfcPcd::communicateThruEx(
+					kDEFAULT_TIMEOUT,
+					NfcPcd::commandBuf(), len,
+					NfcPcd::responseBuf(), &res_len);
+	if (!ret || (res_len < 11) || (NfcPcd::responseBuf(0) != 0x09)
+	  || (memcmp(NfcPcd::responseBuf() + 1, NfcPcd::nfcId(), NfcPcd::NFCID2_LEN) != 0)) {
+		LOGE("write : ret=%d / len=%d / %02x\n", ret, res_len, NfcPcd::responseBuf(0));
+		return false;
+	}
+	if(pStatus) {
+		*pStatus = hl16(NfcPcd::responseBuf(9), NfcPcd::responseBuf(10));
+	}
+	if((NfcPcd::responseBuf(9) != 0x00) || (NfcPcd::responseBuf(10) != 0x00)) {
+		if(_isBlockNumError(NfcPcd::responseBuf(10))) {
+			//ブロック数を減らして送り直すので、エラーにしない
+			LOGD("write : %02x / %02x\n", NfcPcd::responseBuf(9), NfcPcd::responseBuf(10));
+		} else {
+			LOGE("write : %02x / %02x\n", NfcPcd::responseBuf(9), NfcPcd::responseBuf(10));
+		}
+		return false;
+	}
+
+	return true;
 }
 
 
@@ -230,7 +712,7 @@ bool HkNfcF::searchServiceCode()
 		const uint8_t* p = &NfcPcd::responseBuf(9);
 		if(len) {
 			uint16_t svc = uint16_t((*(p+1) << 8) | *p);
-#ifdef HKNFCRW_ENABLE_DEBUG
+#if HKNFCRW_LOG_LEVEL >= HKNFCRW_LOG_DEBUG
 			uint16_t code = uint16_t((svc & 0xffc0) >> 6);
 			uint8_t  attr = svc & 0x003f;
 			if(len == 2) {
@@ -0,0 +1,549 @@
+/**
+ * @file	HkNfcPool.cpp
+ * @brief	複数リーダーのカード検出実装(リーダーごとのスレッド).
+ */
+#include <cstring>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "HkNfcPool.h"
+#include "NfcPcd.h"
+
+#define LOG_TAG "HkNfcPool"
+#include "nfclog.h"
+
+
+namespace {
+	/// 同じカードか(タイプとNFCIDで比べる)
+	bool sameCard(const HkNfcPool::Event& a, const HkNfcPool::Event& b)
+	{
+		return (a.Type == b.Type)
+			&& (a.NfcIdLen == b.NfcIdLen)
+			&& (std::memcmp(a.NfcId, b.NfcId, a.NfcIdLen) == 0);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+// 実装
+///////////////////////////////////////////////////////////////////////////
+
+HkNfcPool::HkNfcPool()
+	: m_ReaderNum(0),
+	  m_bStop(false),
+	  m_StatInterval(0),
+	  m_pStatFile(0),
+	  m_bAdaptiveDetect(false),
+	  m_ArriveCount(1),
+	  m_LeaveCount(1),
+	  m_PresentInterval(0),
+	  m_IdleIntervalMax(0),
+	  m_IdleBackoffAfter(0),
+	  m_bIdleRfOff(false),
+	  m_Head(0),
+	  m_Tail(0),
+	  m_Dropped(0)
+{
+	pthread_mutex_init(&m_Mutex, 0);
+	//時刻を合わせても探索間隔がずれないよう、待ちはCLOCK_MONOTONICで測る
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&m_Cond, &attr);
+	pthread_condattr_destroy(&attr);
+	for(uint32_t i = 0; i < QUEUE_SIZE; i++) {
+		m_Queue[i].Seq = i;
+	}
+	m_EventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(m_EventFd == -1) {
+		LOGE("eventfd : %s\n", strerror(errno));
+	}
+}
+
+
+HkNfcPool::~HkNfcPool()
+{
+	stop();
+	if(m_EventFd != -1) {
+		::close(m_EventFd);
+	}
+	pthread_cond_destroy(&m_Cond);
+	pthread_mutex_destroy(&m_Mutex);
+}
+
+
+/**
+ * リーダー追加
+ *
+ * リーダー用のスレッドを起こし、その中でオープンする.
+ * オープンの結果が出るまで戻らない.
+ *
+ * @param[in]	pPath		デバイスパス(0ならデフォルト)
+ * @param[in]	bNfcA		NFC-Aを探索する
+ * @param[in]	bNfcB		NFC-Bを探索する
+ * @param[in]	bNfcF		NFC-Fを探索する
+ * @param[in]	Interval	探索間隔[msec]
+ * @return		リーダー番号(-1:失敗)
+ *
+ * @attention	- pPathは #stop() するまで保持しておくこと.
+ */
+int HkNfcPool::add(const char* pPath,
+			bool bNfcA/*=true*/, bool bNfcB/*=true*/, bool bNfcF/*=true*/,
+			uint16_t Interval/*=100*/)
+{
+	if((m_ReaderNum == READER_MAX) || (m_EventFd == -1)) {
+		LOGE("add : no reader\n");
+		return -1;
+	}
+
+	Reader& r = m_Reader[m_ReaderNum];
+	r.pPool = this;
+	r.Index = m_ReaderNum;
+	r.pPath = pPath;
+	r.bNfcA = bNfcA;
+	r.bNfcB = bNfcB;
+	r.bNfcF = bNfcF;
+	r.Interval = Interval;
+	r.CurState = ST_ABSENT;
+	r.Polls = 0;
+	r.RfOnUsec = 0;
+	r.StartTime = now();
+	r.bRunning = false;
+	r.bOpened = false;
+
+	if(pthread_create(&r.Thread, 0, readerMain, &r) != 0) {
+		LOGE("pthread_create : %s\n", strerror(errno));
+		return -1;
+	}
+
+	//オープン結果待ち
+	pthread_mutex_lock(&m_Mutex);
+	while(!r.bRunning) {
+		pthread_cond_wait(&m_Cond, &m_Mutex);
+	}
+	pthread_mutex_unlock(&m_Mutex);
+
+	if(!r.bOpened) {
+		pthread_join(r.Thread, 0);
+		return -1;
+	}
+
+	return m_ReaderNum++;
+}
+
+
+/**
+ * 全リーダー停止
+ *
+ * 各スレッドの探索を止め、HkNfcRw::close()して終了するのを待つ.
+ * キューに残っているイベントはそのまま取り出せる.
+ */
+void HkNfcPool::stop()
+{
+	pthread_mutex_lock(&m_Mutex);
+	m_bStop = true;
+	pthread_cond_broadcast(&m_Cond);
+	pthread_mutex_unlock(&m_Mutex);
+
+	for(int i = 0; i < m_ReaderNum; i++) {
+		pthread_join(m_Reader[i].Thread, 0);
+	}
+	m_ReaderNum = 0;
+	m_bStop = false;
+}
+
+
+/**
+ * 到着/離脱を確定させるまでの連続回数
+ *
+ * 違うカードに置き換わったときは、離脱の確定を待ってから新しいカードの到着を数える.
+ * 1なら1回の探索結果ですぐ確定する(デフォルト).
+ *
+ * @param[in]	ArriveCount		同じカードを続けて何回見つけたら到着とするか(0は1とみなす)
+ * @param[in]	LeaveCount		続けて何回見つからなかったら離脱とするか(0は1とみなす)
+ */
+void HkNfcPool::setHysteresis(uint8_t ArriveCount, uint8_t LeaveCount)
+{
+	m_ArriveCount = (ArriveCount) ? ArriveCount : 1;
+	m_LeaveCount = (LeaveCount) ? LeaveCount : 1;
+}
+
+
+/**
+ * カードがある間とない間の探索間隔
+ *
+ * カードがない状態がIdleBackoffAfter続いたら、見つからないたびに探索間隔を倍にしてIdleIntervalMaxまで伸ばす.
+ * カードが見えたら( #ST_ABSENT 以外)すぐにPresentIntervalで探索し、なくなったら #add() の間隔に戻す.
+ *
+ * @param[in]	PresentInterval		カードがある間の探索間隔[msec](0:#add()の間隔)
+ * @param[in]	IdleIntervalMax		カードがない間に伸ばす探索間隔の上限[msec](0:伸ばさない)
+ * @param[in]	IdleBackoffAfter	カードがなくなってから探索間隔を伸ばし始めるまで[msec]
+ */
+void HkNfcPool::setPollInterval(uint16_t PresentInterval, uint16_t IdleIntervalMax, uint32_t IdleBackoffAfter/*=0*/)
+{
+	m_PresentInterval = PresentInterval;
+	m_IdleIntervalMax = IdleIntervalMax;
+	m_IdleBackoffAfter = IdleBackoffAfter;
+}
+
+
+/**
+ * リーダーの状態
+ *
+ * @param[in]	Reader		リーダー番号(#add()の戻り値)
+ * @return		状態(範囲外のリーダー番号は #ST_ABSENT)
+ */
+HkNfcPool::State HkNfcPool::state(int Reader) const
+{
+	if((Reader < 0) || (Reader >= m_ReaderNum)) {
+		return ST_ABSENT;
+	}
+	return static_cast<State>(__atomic_load_n(&m_Reader[Reader].CurState, __ATOMIC_RELAXED));
+}
+
+
+/**
+ * リーダーの探索の統計
+ *
+ * RfOnMsec / ElapsedMsec が搬送波を出していた割合、Polls / ElapsedMsec が探索の頻度になる.
+ *
+ * @param[in]	Reader		リーダー番号(#add()の戻り値)
+ * @param[out]	pStat		統計
+ * @retval		true		取得した
+ * @retval		false		範囲外のリーダー番号
+ */
+bool HkNfcPool::getStat(int Reader, ReaderStat* pStat) const
+{
+	if((Reader < 0) || (Reader >= m_ReaderNum)) {
+		return false;
+	}
+	readStat(&m_Reader[Reader], pStat);
+	return true;
+}
+
+
+/**
+ * イベント取り出し
+ *
+ * @param[out]	pEvent		取り出したイベント
+ * @retval		true		取り出した
+ * @retval		false		キューが空
+ */
+bool HkNfcPool::pop(Event* pEvent)
+{
+	Cell& c = m_Queue[m_Tail & (QUEUE_SIZE - 1)];
+	uint32_t seq = __atomic_load_n(&c.Seq, __ATOMIC_ACQUIRE);
+	if(int32_t(seq - (m_Tail + 1)) < 0) {
+		return false;
+	}
+
+	*pEvent = c.Ev;
+	__atomic_store_n(&c.Seq, m_Tail + QUEUE_SIZE, __ATOMIC_RELEASE);
+	m_Tail++;
+
+	return true;
+}
+
+
+/**
+ * イベント待ち
+ *
+ * @param[out]	pEvent		取り出したイベント
+ * @param[in]	Timeout		待ち時間[msec](-1:無限)
+ * @retval		true		取り出した
+ * @retval		false		タイムアウト
+ */
+bool HkNfcPool::wait(Event* pEvent, int Timeout/*=-1*/)
+{
+	while(!pop(pEvent)) {
+		struct pollfd pfd;
+		pfd.fd = m_EventFd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		int ret = ::poll(&pfd, 1, Timeout);
+		if(ret <= 0) {
+			return pop(pEvent);
+		}
+
+		//書き込み側からの通知を消しておく
+		uint64_t cnt;
+		if(::read(m_EventFd, &cnt, sizeof(cnt)) < 0) {
+			//EAGAIN:先に読まれていた
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * リーダースレッド
+ */
+void* HkNfcPool::readerMain(void* pArg)
+{
+	Reader* pReader = static_cast<Reader*>(pArg);
+	HkNfcPool* pPool = pReader->pPool;
+
+	//このスレッドのHkNfcRwがこのリーダー専用になる
+	bool ret = HkNfcRw::open(pReader->pPath);
+	if(!ret) {
+		LOGE("open fail : %s\n", (pReader->pPath) ? pReader->pPath : "(default)");
+		HkNfcRw::close();
+	}
+	HkNfcRw::setAdaptiveDetect(pPool->m_bAdaptiveDetect);
+
+	pthread_mutex_lock(&pPool->m_Mutex);
+	pReader->bOpened = ret;
+	pReader->bRunning = true;
+	pthread_cond_broadcast(&pPool->m_Cond);
+	pthread_mutex_unlock(&pPool->m_Mutex);
+
+	if(ret) {
+		pPool->loop(pReader);
+		HkNfcRw::close();
+	}
+
+	return 0;
+}
+
+
+/**
+ * 探索ループ
+ *
+ * 選択中のカードがあれば HkNfcRw::isPresent() で同じカードがまだあるかだけを調べ、
+ * なければ探索し直す. その結果で #State を進める.
+ * - #ST_ABSENT / #ST_ARRIVING : 同じカードを #setHysteresis() の到着回数だけ続けて見つけたら、到着を積んで #ST_PRESENT.
+ * - #ST_PRESENT / #ST_LEAVING : 到着したカードが離脱回数だけ続けて見つからなかったら、離脱を積んで #ST_ABSENT.
+ *   違うカードが見えたときも、見つからなかったものとして数える.
+ * #ST_ABSENT のままなら、 #setIdleRfOff() に従って搬送波を止めてから待つ.
+ * #setStatInterval() していれば、その間隔と終了時にこのリーダーのPCDコマンド統計と探索の統計を出力する.
+ */
+void HkNfcPool::loop(Reader* pReader)
+{
+	Event cur;					//到着を積んだカード
+	Event cand;					//到着を確定させようとしているカード
+	Event seen;					//今回見えたカード
+	uint8_t cnt = 0;			//ST_ARRIVING / ST_LEAVINGの連続回数
+	bool bSelected = false;		//HkNfcRwでseenを選択している
+	uint16_t idle = pReader->Interval;
+	uint64_t idle_since = now();	//ST_ABSENTになった時刻
+	uint16_t wait;
+	uint64_t stat_time = now();
+
+	uint64_t rf_base = NfcPcd::rfOnUsec();
+
+	seen.Reader = pReader->Index;
+	do {
+		if(m_StatInterval && (now() - stat_time >= m_StatInterval)) {
+			printStat(pReader);
+			stat_time = now();
+		}
+		__atomic_add_fetch(&pReader->Polls, 1, __ATOMIC_RELAXED);
+
+		if(!bSelected || !HkNfcRw::isPresent()) {
+			seen.Type = HkNfcRw::detect(pReader->bNfcA, pReader->bNfcB, pReader->bNfcF);
+			if(seen.Type != HkNfcRw::NFC_NONE) {
+				seen.NfcIdLen = HkNfcRw::getNfcId(seen.NfcId);
+			} else {
+				seen.NfcIdLen = 0;
+			}
+			bSelected = (seen.Type != HkNfcRw::NFC_NONE);
+		}
+
+		State st = static_cast<State>(pReader->CurState);
+		if((st == ST_PRESENT) || (st == ST_LEAVING)) {
+			if(bSelected && sameCard(seen, cur)) {
+				st = ST_PRESENT;
+			} else {
+				cnt = (st == ST_PRESENT) ? 1 : cnt + 1;
+				st = ST_LEAVING;
+				if(cnt >= m_LeaveCount) {
+					cur.EvKind = Event::EV_LEFT;
+					cur.Timestamp = now();
+					push(cur);
+					st = ST_ABSENT;
+				}
+			}
+		}
+		if((st == ST_ABSENT) || (st == ST_ARRIVING)) {
+			if(!bSelected) {
+				st = ST_ABSENT;
+			} else {
+				if((st == ST_ARRIVING) && sameCard(seen, cand)) {
+					cnt++;
+				} else {
+					cand = seen;
+					cnt = 1;
+				}
+				st = ST_ARRIVING;
+				if(cnt >= m_ArriveCount) {
+					cand.EvKind = Event::EV_ARRIVED;
+					cand.Timestamp = now();
+					push(cand);
+					cur = cand;
+					st = ST_PRESENT;
+				}
+			}
+		}
+		__atomic_store_n(&pReader->CurState, (uint8_t)st, __ATOMIC_RELAXED);
+
+		//カードがない間は間隔を伸ばし、見えたら詰める
+		if(st == ST_ABSENT) {
+			wait = idle;
+			if((m_IdleIntervalMax > idle) && (now() - idle_since >= m_IdleBackoffAfter)) {
+				idle = (idle * 2 < m_IdleIntervalMax) ? idle * 2 : m_IdleIntervalMax;
+			}
+			if(m_bIdleRfOff && NfcPcd::isRfOn()) {
+				//止まっていればUARTのコマンドも送らない
+				NfcPcd::rfOff();
+			}
+		} else {
+			idle = pReader->Interval;
+			idle_since = now();
+			wait = (m_PresentInterval) ? m_PresentInterval : pReader->Interval;
+		}
+		__atomic_store_n(&pReader->RfOnUsec, NfcPcd::rfOnUsec() - rf_base, __ATOMIC_RELAXED);
+	} while(sleep(wait));
+
+	__atomic_store_n(&pReader->RfOnUsec, NfcPcd::rfOnUsec() - rf_base, __ATOMIC_RELAXED);
+	if(m_StatInterval) {
+		printStat(pReader);
+	}
+}
+
+
+/**
+ * 探索の統計を読む
+ *
+ * @param[in]	pReader		リーダー
+ * @param[out]	pStat		統計
+ */
+void HkNfcPool::readStat(const Reader* pReader, ReaderStat* pStat)
+{
+	pStat->Polls = __atomic_load_n(&pReader->Polls, __ATOMIC_RELAXED);
+	pStat->RfOnMsec = __atomic_load_n(&pReader->RfOnUsec, __ATOMIC_RELAXED) / 1000;
+	pStat->ElapsedMsec = now() - pReader->StartTime;
+}
+
+
+/**
+ * このリーダーのPCDコマンド統計と探索の統計を出力する
+ *
+ * 他のリーダーのスレッドの出力と混ざらないよう、出力先をロックしてまとめて出す.
+ *
+ * @param[in]	pReader		リーダー
+ */
+void HkNfcPool::printStat(const Reader* pReader)
+{
+	flockfile(m_pStatFile);
+	NfcPcd::printStat(m_pStatFile, (pReader->pPath) ? pReader->pPath : "(default)");
+	printPollStat(pReader, m_pStatFile);
+	funlockfile(m_pStatFile);
+}
+
+
+/**
+ * 探索の統計を出力する
+ *
+ * @param[in]	pReader		リーダー
+ * @param[in]	fp			出力先
+ */
+void HkNfcPool::printPollStat(const Reader* pReader, FILE* fp)
+{
+	ReaderStat st;
+	readStat(pReader, &st);
+	if(st.ElapsedMsec == 0) {
+		return;
+	}
+	std::fprintf(fp, "[poll stat] polls=%u (%u.%u/s) rf-on=%llums (%u%%)\n",
+			st.Polls,
+			(uint32_t)(st.Polls * 1000ULL / st.ElapsedMsec),
+			(uint32_t)(st.Polls * 10000ULL / st.ElapsedMsec % 10),
+			(unsigned long long)st.RfOnMsec,
+			(uint32_t)(st.RfOnMsec * 100 / st.ElapsedMsec));
+}
+
+
+/**
+ * 探索間隔の待ち
+ *
+ * @param[in]	msec		待ち時間[msec]
+ * @retval		true		時間が経過した
+ * @retval		false		停止要求があった
+ */
+bool HkNfcPool::sleep(uint16_t msec)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);		//m_CondはCLOCK_MONOTONIC
+	ts.tv_sec += msec / 1000;
+	ts.tv_nsec += (msec % 1000) * 1000000L;
+	if(ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&m_Mutex);
+	while(!m_bStop) {
+		if(pthread_cond_timedwait(&m_Cond, &m_Mutex, &ts) == ETIMEDOUT) {
+			break;
+		}
+	}
+	bool ret = !m_bStop;
+	pthread_mutex_unlock(&m_Mutex);
+
+	return ret;
+}
+
+
+/**
+ * イベントを積む(リーダースレッドから呼ぶ)
+ *
+ * 書き込み位置をCASで確保してから書き込み、Seqを進めて読み込み側に公開する.
+ *
+ * @param[in]	ev			積むイベント
+ */
+void HkNfcPool::push(const Event& ev)
+{
+	uint32_t pos = __atomic_load_n(&m_Head, __ATOMIC_RELAXED);
+	Cell* pCell;
+	while(true) {
+		pCell = &m_Queue[pos & (QUEUE_SIZE - 1)];
+		uint32_t seq = __atomic_load_n(&pCell->Seq, __ATOMIC_ACQUIRE);
+		int32_t diff = int32_t(seq - pos);
+		if(diff == 0) {
+			if(__atomic_compare_exchange_n(&m_Head, &pos, pos + 1, true,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if(diff < 0) {
+			//一杯
+			__atomic_add_fetch(&m_Dropped, 1, __ATOMIC_RELAXED);
+			LOGE("queue full\n");
+			return;
+		} else {
+			pos = __atomic_load_n(&m_Head, __ATOMIC_RELAXED);
+		}
+	}
+
+	pCell->Ev = ev;
+	__atomic_store_n(&pCell->Seq, pos + 1, __ATOMIC_RELEASE);
+
+	uint64_t one = 1;
+	if(::write(m_EventFd, &one, sizeof(one)) < 0) {
+		LOGE("eventfd write : %s\n", strerror(errno));
+	}
+}
+
+
+/**
+ * 現在時刻[msec]
+ */
+uint64_t HkNfcPool::now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
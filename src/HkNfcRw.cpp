@@ -15,13 +15,135 @@
 
 using namespace HkNfcRwMisc;
 
-HkNfcRw::Type	HkNfcRw::m_Type = HkNfcRw::NFC_NONE;				///< アクティブなNFCタイプ
+HKNFC_TLS HkNfcRw::Type	HkNfcRw::m_Type = HkNfcRw::NFC_NONE;				///< アクティブなNFCタイプ
+HKNFC_TLS HkNfcRw::Target	HkNfcRw::m_Target[HkNfcRw::TARGET_MAX];			///< 見つけたカード
+HKNFC_TLS uint8_t			HkNfcRw::m_TargetNum = 0;						///< m_Targetの数
+
+
+namespace {
+	/// detect()で探索するNFCタイプの数
+	const uint8_t DETECT_NUM = 3;
+	/// 検出したときにスコアに足す値(スコアは毎回1/4ずつ減らすので、4倍が上限)
+	const uint16_t DETECT_HIT = 64;
+
+	HKNFC_TLS bool s_bAdaptive = false;				///< 探索順を検出実績で入れ替えるかどうか
+	HKNFC_TLS uint16_t s_DetectScore[DETECT_NUM];	///< NFCタイプごとの最近の検出実績(NFC_A, NFC_B, NFC_Fの順)
+
+
+	/**
+	 * 探索順を決める
+	 *
+	 * 最近よく検出したNFCタイプから探す. スコアが同じならF, A, Bの順.
+	 *
+	 * @param[out]	pOrder		探索順
+	 */
+	void _detect_order(HkNfcRw::Type* pOrder)
+	{
+		pOrder[0] = HkNfcRw::NFC_F;
+		pOrder[1] = HkNfcRw::NFC_A;
+		pOrder[2] = HkNfcRw::NFC_B;
+		if(!s_bAdaptive) {
+			return;
+		}
+
+		for(uint8_t i = 1; i < DETECT_NUM; i++) {
+			HkNfcRw::Type type = pOrder[i];
+			uint8_t j = i;
+			while((j > 0) && (s_DetectScore[pOrder[j - 1] - 1] < s_DetectScore[type - 1])) {
+				pOrder[j] = pOrder[j - 1];
+				j--;
+			}
+			pOrder[j] = type;
+		}
+	}
+
+	/**
+	 * 検出実績を更新する
+	 *
+	 * @param[in]	type		検出したNFCタイプ
+	 */
+	void _detect_hit(HkNfcRw::Type type)
+	{
+		for(uint8_t i = 0; i < DETECT_NUM; i++) {
+			s_DetectScore[i] -= s_DetectScore[i] >> 2;
+		}
+		s_DetectScore[type - 1] += DETECT_HIT;
+	}
+
+	/**
+	 * InListPassiveTargetのターゲットのデータからNFCIDを取り出す
+	 *
+	 * @param[in]	type		NFCタイプ
+	 * @param[in]	pTg			ターゲットのデータ(Tgから. NfcPcd::listedTarget()参照)
+	 * @param[in]	len			pTgの長さ
+	 * @param[out]	pTarget		取り出し先
+	 * @retval		true		成功
+	 * @retval		false		データが足りない
+	 */
+	bool _parse_target(HkNfcRw::Type type, const uint8_t* pTg, uint8_t len, HkNfcRw::Target* pTarget)
+	{
+		const uint8_t* id;
+		uint8_t id_len;
+		switch(type) {
+		case HkNfcRw::NFC_A:		//Tg, SENS_RES(2), SEL_RES, NFCID長, NFCID
+			id = pTg + 5;
+			id_len = pTg[4];
+			break;
+		case HkNfcRw::NFC_B:		//Tg, 50h, NFCID0(4), ...
+			id = pTg + 2;
+			id_len = 4;
+			break;
+		case HkNfcRw::NFC_F:		//Tg, 長さ, 01h, IDm(8), PMm(8), ...
+			id = pTg + 3;
+			id_len = NfcPcd::NFCID2_LEN;
+			break;
+		default:
+			return false;
+		}
+		if((id + id_len > pTg + len) || (id_len > HkNfcRw::NFCID_MAX)) {
+			return false;
+		}
+		pTarget->NfcType = type;
+		pTarget->Tg = pTg[0];
+		std::memcpy(pTarget->NfcId, id, id_len);
+		pTarget->NfcIdLen = id_len;
+		if(type == HkNfcRw::NFC_A) {
+			pTarget->SensRes = (uint16_t)((pTg[1] << 8) | pTg[2]);
+			pTarget->SelRes = pTg[3];
+		} else {
+			pTarget->SensRes = 0;
+			pTarget->SelRes = 0;
+		}
+		return true;
+	}
+
+	/**
+	 * 検出結果をトレースに残す(NFCタイプ + NFCID)
+	 *
+	 * @param[in]	type		検出したNFCタイプ
+	 */
+	inline void _trace_detect(HkNfcRw::Type type)
+	{
+#ifdef HKNFCRW_ENABLE_TRACE
+		uint8_t buf[1 + NfcPcd::MAX_NFCID_LEN];
+		uint8_t len = (type != HkNfcRw::NFC_NONE) ? NfcPcd::nfcIdLen() : 0;
+		buf[0] = (uint8_t)type;
+		std::memcpy(buf + 1, NfcPcd::nfcId(), len);
+		NFCTRACE(TR_DETECT, buf, 1 + len);
+#else
+		(void)type;
+#endif
+	}
+}
 
 
 
 /**
  * NFCデバイスオープン
  *
+ * @param[in]	pPath		デバイスパス(0ならデフォルト)
+ * @param[in]	MaxBaud		UARTの通信速度の上限[bps](0なら115200bpsのまま)
+ *
  * @retval	true		成功
  * @retval	false		失敗
  *
@@ -30,16 +152,25 @@ HkNfcRw::Type	HkNfcRw::m_Type = HkNfcRw::NFC_NONE;				///< アクティブなNFC
  * 				- 終了時には#close()を呼び出すこと。
  *
  * @note		- 呼び出しただけでは搬送波を出力しない。
+ * 				- 状態はスレッドごとに持つ(HkNfcTls.h参照)。
+ * 				  複数のリーダーを使う場合は、リーダーごとのスレッドでpPathを指定して呼び出すこと。
+ * 				- MaxBaudを指定すると、それ以下でPCDとホストが対応している一番速い速度に切り替える。
+ * 				  切り替えられなくても失敗にはしない(NfcPcd::baudRate()で確認できる)が、
+ * 				  切り替えたあとPCDと通信できなくなったときは失敗にする。
  */
-bool HkNfcRw::open()
+bool HkNfcRw::open(const char* pPath/*=0*/, uint32_t MaxBaud/*=0*/)
 {
 	LOGD("%s\n", __PRETTY_FUNCTION__);
 
-	if(!NfcPcd::portOpen()) {
+	if(!NfcPcd::portOpen(pPath)) {
 		return false;
 	}
+	std::memset(s_DetectScore, 0, sizeof(s_DetectScore));
 
 	bool ret = NfcPcd::init();
+	if(ret && (MaxBaud > NfcPcd::DEFAULT_BAUD)) {
+		ret = (NfcPcd::negotiateBaudRate(MaxBaud) != 0);
+	}
 	if(!ret) {
 		close();
 	}
@@ -48,6 +179,52 @@ bool HkNfcRw::open()
 }
 
 
+/**
+ * NFCデバイスを開き直す
+ *
+ * 通信エラーのあとなどに、PCDをResetせずにポートだけを開き直す.
+ * NfcPcd::init()のウォームスタートで、前回送ったRFConfigurationと通信速度をそのまま使う.
+ * PCDが応答しないときは、#open()と同じ初期化になる.
+ *
+ * @param[in]	pPath		デバイスパス(0ならデフォルト)
+ * @param[in]	MaxBaud		UARTの通信速度の上限[bps](0なら今の速度のまま)
+ *
+ * @retval	true		成功
+ * @retval	false		失敗
+ *
+ * @attention	- falseの場合、呼び出し側が#close()すること。
+ * 				- PCDが電源断やResetをしていないときだけ使うこと。
+ * 				  起動し直したPCDも115200bpsならGetGeneralStatusに応答するので、
+ * 				  RFConfigurationが初期値に戻っていても送り直さない。
+ * 				  起動し直したと分かるのは、通信速度を上げていて応答がなくなったときだけ。
+ * 				  PCDの電源が切れた可能性があるときは#close()して#open()すること。
+ *
+ * @note		- 選択していたカードは解放する。
+ * 				- #close()のあとに呼ぶと、PCDはResetされているので#open()と同じになる。
+ */
+bool HkNfcRw::reopen(const char* pPath/*=0*/, uint32_t MaxBaud/*=0*/)
+{
+	LOGD("%s\n", __PRETTY_FUNCTION__);
+
+	uint32_t baud = NfcPcd::baudRate();
+	NfcPcd::portClose();
+	release();
+	if(!NfcPcd::portOpen(pPath, baud)) {
+		return false;
+	}
+
+	bool ret = NfcPcd::init(true);
+	if(ret && (MaxBaud > NfcPcd::baudRate())) {
+		ret = (NfcPcd::negotiateBaudRate(MaxBaud) != 0);
+	}
+	if(!ret) {
+		close();
+	}
+
+	return ret;
+}
+
+
 /**
  * NFCデバイスをクローズする。
  *
@@ -58,6 +235,8 @@ bool HkNfcRw::open()
 void HkNfcRw::close()
 {
 	if(NfcPcd::isOpened()) {
+		//次にオープンするときのために、起動時の速度に戻しておく
+		NfcPcd::setSerialBaudRate(NfcPcd::DEFAULT_BAUD);
 		NfcPcd::reset();
 		NfcPcd::rfOff();
 		NfcPcd::portClose();
@@ -74,58 +253,203 @@ void HkNfcRw::release()
 {
 	NfcPcd::clrNfcId();
 	m_Type = NFC_NONE;
+	m_TargetNum = 0;
 }
 
 
 /**
  * ターゲットの探索
  *
- * @param[in]	pNfcA	NfcA(null時は探索しない)
- * @param[in]	pNfcB	NfcB(null時は探索しない)
- * @param[in]	pNfcF	NfcF(null時は探索しない)
+ * @param[in]	bNfcA	NFC-Aを探索するかどうか
+ * @param[in]	bNfcB	NFC-Bを探索するかどうか
+ * @param[in]	bNfcF	NFC-Fを探索するかどうか
  *
- * @retval	true		成功
- * @retval	false		失敗
+ * @return		検出したNFCタイプ(NFC_NONE:検出しなかった)
  *
  * @note		- #open()後に呼び出すこと。
  * 				- アクティブなカードが変更された場合に呼び出すこと。
+ * 				- 探索はF, A, Bの順。#setAdaptiveDetect()で有効にすると、最近よく検出したタイプから探す。
  */
 HkNfcRw::Type HkNfcRw::detect(bool bNfcA, bool bNfcB, bool bNfcF)
 {
-	m_Type = NFC_NONE;
+	return _detect(bNfcA, bNfcB, bNfcF, 1);
+}
 
-	if(bNfcF) {
-        bool ret = HkNfcF::polling();
-		if(ret) {
-			LOGD("PollingF\n");
-			m_Type = NFC_F;
-			return m_Type;
-		}
+
+/**
+ * 選択しているカードがまだあるか
+ *
+ * 保持しているNFCIDのカードに軽いコマンドを1つ送り、応答があるかで判断する.
+ * カードがあるか知りたいだけなら、#detect()を繰り返すよりRFの時間が短く、離れたことも早く分かる.
+ * - NFC-F : Request Response (HkNfcF::isPresent())
+ * - NFC-A / NFC-B : DiagnoseのAttention Request Test (NfcPcd::attentionRequest())
+ *
+ * @retval		true		まだある
+ * @retval		false		なくなった(#release()した状態になる)
+ *
+ * @note		- #detect() / #selectTarget() で選択したカードに対して呼び出すこと。
+ * @attention	- Attention Request TestはTgを指定できず、PCDが最後に活性化したターゲットを調べる.
+ * 				  NFC-A/Bで #selectTarget() で切り替えた直後は、切り替え先とまだ通信していなければ
+ * 				  別のカード(Tg=1など)の結果になる.
+ */
+bool HkNfcRw::isPresent()
+{
+	bool ret;
+	switch(m_Type) {
+	case NFC_F:
+		ret = HkNfcF::isPresent();
+		break;
+	case NFC_A:
+	case NFC_B:
+		ret = NfcPcd::attentionRequest();
+		break;
+	default:
+		ret = false;
+		break;
+	}
+	if(!ret) {
+		LOGD("card removed\n");
+		release();
 	}
 
-	if(bNfcA) {
-        bool ret = HkNfcA::polling();
-		if(ret) {
-			LOGD("PollingA\n");
-			m_Type = NFC_A;
-			return m_Type;
-		}
+	return ret;
+}
+
+
+/**
+ * 重なったカードをまとめて探索
+ *
+ * #detect()と同じ順に探し、最初に応答したNFCタイプのカードを
+ * 1回のInListPassiveTarget(MaxTg=#TARGET_MAX)で全部取得する.
+ * 取得したカードは#getTarget()で参照でき、Tg=1のカードが選択された状態になる.
+ *
+ * @param[in]	bNfcA	NFC-Aを探索するかどうか
+ * @param[in]	bNfcB	NFC-Bを探索するかどうか
+ * @param[in]	bNfcF	NFC-Fを探索するかどうか
+ *
+ * @return		見つけたカードの数(0:検出しなかった)
+ *
+ * @note		- 別のNFCタイプのカードが一緒に重なっていても、見つけるのは1タイプだけ。
+ */
+uint8_t HkNfcRw::detectAll(bool bNfcA, bool bNfcB, bool bNfcF)
+{
+	_detect(bNfcA, bNfcB, bNfcF, TARGET_MAX);
+	return m_TargetNum;
+}
+
+
+/**
+ * カード切り替え
+ *
+ * #detectAll()で見つけたカードを、以降のカード操作の相手にする.
+ *
+ * @param[in]	Index	0～#getTargetNum()-1
+ *
+ * @retval		true		成功
+ * @retval		false		Indexが範囲外
+ *
+ * @note		- PCDへのコマンドは送らない。NFCIDとTg(NFC-AはSENS_RES/SEL_RESも)を切り替えるだけ。
+ */
+bool HkNfcRw::selectTarget(uint8_t Index)
+{
+	if(Index >= m_TargetNum) {
+		LOGE("bad target : %d\n", Index);
+		return false;
+	}
+
+	const Target& t = m_Target[Index];
+	NfcPcd::setNfcId(t.NfcId, t.NfcIdLen);
+	NfcPcd::setTargetNo(t.Tg);
+	if(t.NfcType == NFC_A) {
+		HkNfcA::setTargetInfo(t.SensRes, t.SelRes);
+	} else if(t.NfcType == NFC_F) {
+		//1コマンドあたりのブロック数はカードごとに覚え直す
+		HkNfcF::release();
 	}
+	m_Type = t.NfcType;
 
-	if(bNfcB) {
-        bool ret = HkNfcB::polling();
+	return true;
+}
+
+
+/**
+ * ターゲットの探索(共通)
+ *
+ * @param[in]	bNfcA	NFC-Aを探索するかどうか
+ * @param[in]	bNfcB	NFC-Bを探索するかどうか
+ * @param[in]	bNfcF	NFC-Fを探索するかどうか
+ * @param[in]	MaxTg	1タイプで取得する最大カード数
+ *
+ * @return		検出したNFCタイプ(NFC_NONE:検出しなかった)
+ */
+HkNfcRw::Type HkNfcRw::_detect(bool bNfcA, bool bNfcB, bool bNfcF, uint8_t MaxTg)
+{
+	m_Type = NFC_NONE;
+	m_TargetNum = 0;
+
+	Type order[DETECT_NUM];
+	_detect_order(order);
+	for(uint8_t i = 0; i < DETECT_NUM; i++) {
+		bool ret = false;
+		switch(order[i]) {
+		case NFC_F:
+			if(bNfcF) {
+				ret = HkNfcF::polling(0xffff, MaxTg);
+			}
+			break;
+		case NFC_A:
+			if(bNfcA) {
+				ret = HkNfcA::polling(MaxTg);
+			}
+			break;
+		case NFC_B:
+			if(bNfcB) {
+				ret = HkNfcB::polling(MaxTg);
+			}
+			break;
+		default:
+			break;
+		}
 		if(ret) {
-			LOGD("PollingB\n");
-			m_Type = NFC_B;
+			LOGD("Polling%c\n", "-ABF"[order[i]]);
+			m_Type = order[i];
+			for(uint8_t tg = 0; tg < NfcPcd::listedTargetNum(); tg++) {
+				uint8_t len;
+				const uint8_t* p = NfcPcd::listedTarget(tg, &len);
+				if(_parse_target(m_Type, p, len, &m_Target[m_TargetNum])) {
+					m_TargetNum++;
+				}
+			}
+			_detect_hit(m_Type);
+			_trace_detect(m_Type);
 			return m_Type;
 		}
 	}
 	LOGD("Detect fail\n");
+	_trace_detect(NFC_NONE);
 
 	return NFC_NONE;
 }
 
 
+/**
+ * 探索順を検出実績で入れ替えるかどうか
+ *
+ * 有効にすると、#detect()はこのスレッド(リーダー)で最近よく検出したNFCタイプから探す.
+ * 1種類のカードばかりの場所では、外れるタイプのタイムアウトを待たずに済む.
+ * 実績は検出するたびに古いものを1/4ずつ減らし、#open()で捨てる.
+ *
+ * @param[in]	bEnable		true:有効 / false:F, A, Bの順に固定(デフォルト)
+ *
+ * @note		- RC-S620/SにはInAutoPollがないので、探索はタイプごとのInListPassiveTargetのまま.
+ * 				- 複数タイプのカードを同時にかざしたとき、どれを返すかは実績によって変わる.
+ */
+void HkNfcRw::setAdaptiveDetect(bool bEnable)
+{
+	s_bAdaptive = bEnable;
+}
+
+
 /**
  * @brief UIDの取得
  *
@@ -3,10 +3,10 @@
 #include "HkNfcLlcpT.h"
 
 
-const HkNfcNdefMsg*		HkNfcSnep::m_pMessage = 0;
-HkNfcSnep::Mode			HkNfcSnep::m_Mode = HkNfcSnep::MD_TARGET;
-HkNfcSnep::Status		HkNfcSnep::m_Status = HkNfcSnep::ST_INIT;
-bool					(*HkNfcSnep::m_PollFunc)();
+HKNFC_TLS const HkNfcNdefMsg*		HkNfcSnep::m_pMessage = 0;
+HKNFC_TLS HkNfcSnep::Mode			HkNfcSnep::m_Mode = HkNfcSnep::MD_TARGET;
+HKNFC_TLS HkNfcSnep::Status		HkNfcSnep::m_Status = HkNfcSnep::ST_INIT;
+HKNFC_TLS bool					(*HkNfcSnep::m_PollFunc)();
 
 
 namespace {
@@ -59,7 +59,12 @@ bool HkNfcSnep::putStart(Mode mode, const HkNfcNdefMsg* pMsg)
 
 bool HkNfcSnep::poll()
 {
-	return (*m_PollFunc)();
+	bool b = (*m_PollFunc)();
+	if(!b) {
+		//終わったので、次のputStart()を受け付ける
+		m_pMessage = 0;
+	}
+	return b;
 }
 
 
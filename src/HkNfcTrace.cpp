@@ -0,0 +1,166 @@
+/**
+ * @file	HkNfcTrace.cpp
+ * @brief	フレームとイベントのバイナリトレース実装.
+ */
+#include <cstring>
+
+#include "HkNfcTrace.h"
+#include "HkNfcTls.h"
+#include "misc.h"
+
+using namespace HkNfcRwMisc;
+
+
+namespace {
+	const char* KIND_NAME[] = {
+		"TX", "RX", "ACK", "NACK", "NOACK", "ERRFRAME", "RXERR", "DETECT"
+	};
+
+	/// リングバッファ(全スレッド共通)
+	HkNfcTrace::Record s_Ring[HkNfcTrace::RECORD_NUM];
+	/// 次に書き込む通し番号
+	uint32_t s_Head = 0;
+	/// これより前の通し番号は捨てたものとする(#clear())
+	uint32_t s_Tail = 0;
+	/// スレッド番号の払い出し
+	uint8_t s_ThreadNum = 0;
+
+	/// このスレッドの番号(0:未払い出し)
+	HKNFC_TLS uint8_t s_Thread = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////
+// 実装
+///////////////////////////////////////////////////////////////////////////
+
+/**
+ * 記録
+ *
+ * @param[in]	kind		種類
+ * @param[in]	pData		データ(lenが0なら未使用)
+ * @param[in]	len			pDataの長さ(DATA_MAXを超えた分は残さない)
+ */
+void HkNfcTrace::record(Kind kind, const uint8_t* pData, uint16_t len)
+{
+	record(kind, pData, len, 0, 0);
+}
+
+
+/**
+ * 記録(2つに分かれたデータ)
+ *
+ * pHeadの後ろにpDataを続けたものとして記録する.
+ * 通し番号をatomicに進めて書き込む場所を確保するので、複数スレッドから同時に呼んでよい.
+ * 書き込み中はSeqを0にしておき、書き終わってから通し番号+1を入れる.
+ *
+ * @param[in]	kind		種類
+ * @param[in]	pHead		前半のデータ(HeadLenが0なら未使用)
+ * @param[in]	HeadLen		pHeadの長さ
+ * @param[in]	pData		後半のデータ(DataLenが0なら未使用)
+ * @param[in]	DataLen		pDataの長さ
+ */
+void HkNfcTrace::record(Kind kind,
+			const uint8_t* pHead, uint16_t HeadLen,
+			const uint8_t* pData, uint16_t DataLen)
+{
+	if(s_Thread == 0) {
+		s_Thread = __atomic_add_fetch(&s_ThreadNum, 1, __ATOMIC_RELAXED);
+	}
+
+	uint32_t pos = __atomic_fetch_add(&s_Head, 1, __ATOMIC_RELAXED);
+	Record& r = s_Ring[pos & (RECORD_NUM - 1)];
+	__atomic_store_n(&r.Seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	r.Kind = (uint8_t)kind;
+	r.Thread = s_Thread;
+	r.Len = HeadLen + DataLen;
+	r.Usec = nowUsec();
+	uint16_t head = (HeadLen < DATA_MAX) ? HeadLen : DATA_MAX;
+	if(head) {
+		std::memcpy(r.Data, pHead, head);
+	}
+	uint16_t data = (DataLen < DATA_MAX - head) ? DataLen : DATA_MAX - head;
+	if(data) {
+		std::memcpy(r.Data + head, pData, data);
+	}
+
+	__atomic_store_n(&r.Seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * 古い順に取り出す
+ *
+ * 取り出している間に上書きされたレコードは飛ばす.
+ *
+ * @param[out]	pBuf		取り出し先
+ * @param[in]	num			pBufのレコード数
+ * @return		取り出したレコード数
+ */
+uint32_t HkNfcTrace::snapshot(Record* pBuf, uint32_t num)
+{
+	uint32_t head = __atomic_load_n(&s_Head, __ATOMIC_ACQUIRE);
+	uint32_t start = __atomic_load_n(&s_Tail, __ATOMIC_RELAXED);
+	if(head - start > RECORD_NUM) {
+		start = head - RECORD_NUM;
+	}
+	if(head - start > num) {
+		//新しい方を残す
+		start = head - num;
+	}
+
+	uint32_t cnt = 0;
+	for(uint32_t pos = start; pos != head; pos++) {
+		const Record& r = s_Ring[pos & (RECORD_NUM - 1)];
+		if(__atomic_load_n(&r.Seq, __ATOMIC_ACQUIRE) != pos + 1) {
+			continue;
+		}
+		pBuf[cnt] = r;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&r.Seq, __ATOMIC_RELAXED) != pos + 1) {
+			continue;
+		}
+		cnt++;
+	}
+
+	return cnt;
+}
+
+
+/**
+ * テキストで出力
+ *
+ * 1レコード1行で、時刻は最初のレコードからの経過時間[usec].
+ *
+ * @param[in]	fp			出力先
+ */
+void HkNfcTrace::print(FILE* fp)
+{
+	static Record buf[RECORD_NUM];
+	uint32_t num = snapshot(buf, RECORD_NUM);
+
+	for(uint32_t i = 0; i < num; i++) {
+		const Record& r = buf[i];
+		const char* name = (r.Kind < sizeof(KIND_NAME) / sizeof(KIND_NAME[0])) ? KIND_NAME[r.Kind] : "?";
+		std::fprintf(fp, "%10llu T%u %-8s %3u:",
+				(unsigned long long)(r.Usec - buf[0].Usec), r.Thread, name, r.Len);
+		uint16_t len = (r.Len < DATA_MAX) ? r.Len : DATA_MAX;
+		for(uint16_t j = 0; j < len; j++) {
+			std::fprintf(fp, " %02x", r.Data[j]);
+		}
+		std::fprintf(fp, "%s\n", (r.Len > DATA_MAX) ? " ..." : "");
+	}
+}
+
+
+/**
+ * 記録を捨てる
+ *
+ * 以降の #snapshot() では、これより前のレコードを返さない.
+ */
+void HkNfcTrace::clear()
+{
+	__atomic_store_n(&s_Tail, __atomic_load_n(&s_Head, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+}
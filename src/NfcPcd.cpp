@@ -5,8 +5,11 @@
  */
 
 #include <cstdlib>
+#include <cstdio>
+#include <cinttypes>
 #include "NfcPcd.h"
 #include "devaccess.h"
+#include "nfccapture.h"
 #include "misc.h"
 
 // ログ用
@@ -16,12 +19,14 @@
 
 using namespace HkNfcRwMisc;
 
-bool NfcPcd::m_bOpened = false;		///< オープンしているかどうか
+HKNFC_TLS bool NfcPcd::m_bOpened = false;		///< オープンしているかどうか
+HKNFC_TLS uint32_t NfcPcd::m_BaudRate = NfcPcd::DEFAULT_BAUD;	///< 現在のUART通信速度[bps]
 
-uint8_t		NfcPcd::s_CommandBuf[NfcPcd::DATA_MAX];		///< PCDへの送信バッファ
-uint8_t		NfcPcd::s_ResponseBuf[NfcPcd::DATA_MAX];	///< PCDからの受信バッファ
-uint8_t		NfcPcd::m_NfcId[NfcPcd::MAX_NFCID_LEN];		///< 取得したNFCID
-uint8_t		NfcPcd::m_NfcIdLen;					///< 取得済みのNFCID長。0の場合は未取得。
+HKNFC_TLS uint8_t		NfcPcd::s_CommandBuf[NfcPcd::DATA_MAX];		///< PCDへの送信バッファ
+HKNFC_TLS uint8_t		NfcPcd::s_ResponseBuf[NfcPcd::DATA_MAX];	///< PCDからの受信バッファ
+HKNFC_TLS uint8_t		NfcPcd::m_NfcId[NfcPcd::MAX_NFCID_LEN];		///< 取得したNFCID
+HKNFC_TLS uint8_t		NfcPcd::m_NfcIdLen;					///< 取得済みのNFCID長。0の場合は未取得。
+HKNFC_TLS uint8_t		NfcPcd::m_TargetNo = 1;				///< InDataExchangeの相手のTg
 
 /**
  * const
@@ -33,25 +38,130 @@ namespace {
 	
 	const int POS_RESDATA = 2;
 	const uint8_t ACK[] = { 0x00, 0x00, 0xff, 0x00, 0xff, 0x00 };
+	const uint8_t NACK[] = { 0x00, 0x00, 0xff, 0xff, 0x00, 0x00 };
 	
-	const int POS_NORMALFRM_DATA = 5;
 	const int POS_EXTENDFRM_DATA = 8;
+	const int FRMTAIL_LEN = 2;
+	/// ACKやフレームの先頭を探すときに読み飛ばす最大byte数(フレーム1つ分)
+	const uint16_t RESYNC_MAX = RWBUF_MAX;
+
+	/// SetSerialBaudRateで指定できる通信速度(遅い順。添字がコマンドの値)
+	const uint32_t SERIAL_BAUD[] = {
+		9600, 19200, 38400, 57600, 115200, 230400, 460800
+	};
+	const uint8_t SERIAL_BAUD_NUM = sizeof(SERIAL_BAUD) / sizeof(SERIAL_BAUD[0]);
 }
 
 /**
  * バッファ
  */
 namespace {
-	/// 送信バッファ
-	uint8_t s_SendBuf[RWBUF_MAX];
+	/// 送信コマンドの組み立て用(フレームのデータ部)
+	HKNFC_TLS uint8_t s_NormalFrmBuf[RWBUF_MAX];
 
-	/// Normalフレームのデータ部
-	uint8_t* s_NormalFrmBuf = &(s_SendBuf[POS_NORMALFRM_DATA]);
-	/// Extendedフレームのデータ部
-	uint8_t* s_ExtendFrmBuf = &(s_SendBuf[POS_EXTENDFRM_DATA]);
+	/// 送信フレームのヘッダ(Preamble, Start Code, LEN, LCS)
+	HKNFC_TLS uint8_t s_FrmHead[POS_EXTENDFRM_DATA];
+	/// 送信フレームのフッタ(DCS, Postamble)
+	HKNFC_TLS uint8_t s_FrmTail[FRMTAIL_LEN];
+}
+
+
+/**
+ * 統計
+ */
+namespace {
+	HKNFC_TLS NfcPcd::CmdStat s_Stat[NfcPcd::STAT_MAX];	///< コマンドコードごとの統計
+	HKNFC_TLS uint8_t s_StatNum = 0;						///< s_Statの使用数
+	HKNFC_TLS NfcPcd::CmdStat* s_pCurStat = 0;				///< 最後に送信したコマンドの統計(0:記録しない)
+	HKNFC_TLS uint8_t s_RetryLimit = 0;						///< 同じ結果になるコマンドを送り直す回数
+	HKNFC_TLS bool s_bRfOn = false;							///< 搬送波を出しているはずか
+	HKNFC_TLS uint64_t s_RfOnTime = 0;						///< 搬送波を出し始めた時刻[usec]
+	HKNFC_TLS uint64_t s_RfOnUsec = 0;						///< 搬送波を止めるまでの時間の合計[usec]
+}
+
+
+/**
+ * RFConfiguration
+ */
+namespace {
+	/// #NfcPcd::init()で送るRFConfigurationのデフォルト
+	const NfcPcd::RfConfig DEFAULT_RFCONFIG = {
+		// RF通信のT/O
+		{
+			0x00,		// RFU
+			0x00,		// ATR_RES : no timeout
+			0x00		// 非DEP通信時 : no timeout
+		},
+		// Target捕捉時のRF通信リトライ回数
+		{
+			0x00,		// ATR_REQ/RES : only once
+			0x00,		// PSL_REQ/RES : only once
+			0x00		// InListPassiveTarget : only once
+		},
+		// RF出力ONからTargetID取得コマンド送信までの追加ウェイト時間
+		0xb7,			// 0.1 x prm + 5 + 0.7 [ms]
+						// 0xb7は、サンプルソースの値
+		// DEPターゲットでのタイムアウト
+		{
+			0x08,		// gbyAtrResTo
+							// 00h :    302us
+							// 01h :    604us
+							// 02h :   1.208ms
+							// 03h :   2.417ms
+							// 04h :   4.833ms
+							// 05h :   9.666ms
+							// 06h :  19.332ms
+							// 07h :  38.664ms
+							// 08h :  77.329ms ★
+							// 09h : 154.657ms
+							// 0ah : 309.314ms
+							// 0bh : 618.629ms
+							// 0ch :   1.237s
+							// 0dh :   2.474s
+							// 0eh :   4.949s
+			0x01,		// gbyRtox
+							// RWT x gbyRtox
+			0x08		// gbyTargetStoTo
+							// 00h : 951us
+							// 01h : 1.1ms
+							// 02h : 1.4ms
+							// 03h : 2.0ms
+							// 04h : 3.2ms
+							// 05h : 5.6ms
+							// 06h : 10.4ms
+							// 07h : 20.1ms
+							// 08h : 39.4ms ★
+							// 09h : 78.1ms
+							// 0ah : 155.4ms
+							// 0bh : 310.0ms
+							// 0ch : 619.sms
+							// 0dh : 1.237s
+							// 0eh : 2.474s
+		}
+	};
+
+	HKNFC_TLS NfcPcd::RfConfig s_RfConfig = DEFAULT_RFCONFIG;	///< #NfcPcd::init()で送る設定
+	HKNFC_TLS NfcPcd::RfConfig s_Applied;					///< 最後に送った設定
+	HKNFC_TLS bool s_bApplied = false;						///< s_AppliedがPCDに残っているはずか(Resetで消える)
+}
 
-	/// 受信バッファ
-	uint8_t s_ResponseBuf[RWBUF_MAX];
+
+/**
+ * InListPassiveTargetで取得したターゲット
+ */
+namespace {
+	HKNFC_TLS uint8_t s_ListNum = 0;					///< ターゲット数
+	HKNFC_TLS uint16_t s_ListPos[NfcPcd::MAX_TG];		///< s_ResponseBufでのターゲットの位置(Tgから)
+	HKNFC_TLS uint8_t s_ListLen[NfcPcd::MAX_TG];		///< ターゲットのデータ長(Tg含む)
+}
+
+
+/**
+ * キャプチャ
+ */
+namespace {
+	HKNFC_TLS FILE* s_pCapture = 0;			///< キャプチャの出力先(0:キャプチャしていない)
+	HKNFC_TLS uint64_t s_CaptureTime = 0;	///< 前のレコードの時刻[usec]
 }
 
 
@@ -63,18 +173,303 @@ namespace {
 	/**
 	 * DCS計算
 	 *
+	 * 複数に分かれたデータは、前回の戻り値をsumに渡して順に計算する.
+	 *
 	 * @param[in]		data		計算元データ
 	 * @param[in]		len			dataの長さ
+	 * @param[in]		sum			途中までの合計(最初は0)
 	 *
-	 * @return			DCS値
+	 * @return			合計値(DCSは0からこれを引いた値)
 	 */
-	uint8_t _calc_dcs(const uint8_t* data, uint16_t len)
+	uint8_t _calc_sum(const uint8_t* data, uint16_t len, uint8_t sum=0)
 	{
-		uint8_t sum = 0;
 		for(uint16_t i = 0; i < len; i++) {
 			sum += data[i];
 		}
-		return (uint8_t)(0 - (sum & 0xff));
+		return sum;
+	}
+
+	/**
+	 * DCS計算
+	 *
+	 * @param[in]		data		計算元データ
+	 * @param[in]		len			dataの長さ
+	 *
+	 * @return			DCS値
+	 */
+	uint8_t _calc_dcs(const uint8_t* data, uint16_t len)
+	{
+		return (uint8_t)(0 - _calc_sum(data, len));
+	}
+
+	/**
+	 * InListPassiveTargetのレスポンスのターゲット1つ分の長さ
+	 *
+	 * @param[in]		BrTy		InListPassiveTargetのBrTy
+	 * @param[in]		pTg			ターゲットのデータ(Tgから)
+	 * @param[in]		Remain		pTgから後ろのレスポンス長
+	 * @return			Tgを含む長さ(0:形式が分からないか、足りない)
+	 */
+	uint16_t _target_len(uint8_t BrTy, const uint8_t* pTg, uint16_t Remain)
+	{
+		uint16_t len = 0;
+		switch(BrTy) {
+		case 0x00:		//106kbps Type A : Tg, SENS_RES(2), SEL_RES, NFCID長, NFCID, [ATS]
+			if(Remain >= 5) {
+				len = 5 + pTg[4];
+				if((pTg[3] & 0x20) && (Remain > len)) {
+					len += pTg[len];
+				}
+			}
+			break;
+		case 0x01:		//212kbps FeliCa : Tg, POL_RES(長さから)
+		case 0x02:		//424kbps FeliCa
+			if(Remain >= 2) {
+				len = 1 + pTg[1];
+			}
+			break;
+		case 0x03:		//106kbps Type B : Tg, ATQB(12), ATTRIB_RES長, ATTRIB_RES
+			if(Remain >= 14) {
+				len = 14 + pTg[13];
+			}
+			break;
+		default:
+			break;
+		}
+		return (len <= Remain) ? len : 0;
+	}
+
+	/**
+	 * キャプチャにレコードを1つ書く
+	 *
+	 * @param[in]		dir			向き
+	 * @param[in]		seg			データの断片
+	 * @param[in]		num			segの数
+	 * @param[in]		len			書くデータ長(segの先頭から)
+	 */
+	void _capture(NfcCapture::Dir dir, const DevAccess::Segment* seg, uint8_t num, uint16_t len)
+	{
+		uint64_t now = nowUsec();
+		uint32_t delta = (uint32_t)(now - s_CaptureTime);
+		s_CaptureTime = now;
+
+		uint8_t head[NfcCapture::RECHEAD_LEN];
+		head[0] = (uint8_t)dir;
+		head[1] = l16(len);
+		head[2] = h16(len);
+		head[3] = (uint8_t)delta;
+		head[4] = (uint8_t)(delta >> 8);
+		head[5] = (uint8_t)(delta >> 16);
+		head[6] = (uint8_t)(delta >> 24);
+		fwrite(head, 1, sizeof(head), s_pCapture);
+		for(uint8_t i = 0; (i < num) && len; i++) {
+			uint16_t n = (seg[i].Len < len) ? seg[i].Len : len;
+			fwrite(seg[i].pData, 1, n, s_pCapture);
+			len -= n;
+		}
+	}
+
+	/**
+	 * ポート送信(キャプチャ付き)
+	 *
+	 * @param[in]		seg			送信データの断片
+	 * @param[in]		num			segの数
+	 * @return			送信したサイズ
+	 */
+	uint16_t _port_writev(const DevAccess::Segment* seg, uint8_t num)
+	{
+		uint16_t ret = DevAccess::writev(seg, num);
+		if(s_pCapture && ret) {
+			_capture(NfcCapture::DIR_TX, seg, num, ret);
+		}
+		return ret;
+	}
+
+	/**
+	 * ポート送信(キャプチャ付き)
+	 *
+	 * @param[in]		data		送信データ
+	 * @param[in]		len			dataの長さ
+	 * @return			送信したサイズ
+	 */
+	uint16_t _port_write(const uint8_t* data, uint16_t len)
+	{
+		uint16_t ret = DevAccess::write(data, len);
+		if(s_pCapture && ret) {
+			DevAccess::Segment seg;
+			seg.pData = data;
+			seg.Len = ret;
+			_capture(NfcCapture::DIR_TX, &seg, 1, ret);
+		}
+		return ret;
+	}
+
+	/**
+	 * ポート受信(キャプチャ付き)
+	 *
+	 * @param[out]		data		受信バッファ
+	 * @param[in]		len			受信サイズ
+	 * @return			受信したサイズ
+	 */
+	uint16_t _port_read(uint8_t* data, uint16_t len)
+	{
+		uint16_t ret = DevAccess::read(data, len);
+		if(s_pCapture && ret) {
+			DevAccess::Segment seg;
+			seg.pData = data;
+			seg.Len = ret;
+			_capture(NfcCapture::DIR_RX, &seg, 1, ret);
+		}
+		return ret;
+	}
+
+	/**
+	 * コマンドコードの統計を探す(なければ追加する)
+	 *
+	 * @param[in]		Code		コマンドコード
+	 *
+	 * @return			統計(0:一杯で追加できない)
+	 */
+	NfcPcd::CmdStat* _find_stat(uint8_t Code)
+	{
+		for(uint8_t i = 0; i < s_StatNum; i++) {
+			if(s_Stat[i].Code == Code) {
+				return &s_Stat[i];
+			}
+		}
+		if(s_StatNum == NfcPcd::STAT_MAX) {
+			return 0;
+		}
+		NfcPcd::CmdStat* p = &s_Stat[s_StatNum++];
+		std::memset(p, 0, sizeof(NfcPcd::CmdStat));
+		p->Code = Code;
+		return p;
+	}
+
+	/**
+	 * 時間分布に加える
+	 *
+	 * @param[in,out]	pHist		時間分布
+	 * @param[in]		usec		時間[usec]
+	 */
+	void _add_hist(uint32_t* pHist, uint64_t usec)
+	{
+		int idx = (usec) ? 63 - __builtin_clzll(usec) : 0;
+		if(idx >= NfcPcd::STAT_HIST_NUM) {
+			idx = NfcPcd::STAT_HIST_NUM - 1;
+		}
+		pHist[idx]++;
+	}
+
+	/**
+	 * ACKかNACKか
+	 *
+	 * @param[in]		pBuf		受信データ(6byte)
+	 */
+	bool _is_ack(const uint8_t* pBuf)
+	{
+		return (memcmp(pBuf, ACK, sizeof(ACK)) == 0) || (memcmp(pBuf, NACK, sizeof(NACK)) == 0);
+	}
+
+	/**
+	 * フレームの先頭(Preamble, Start Code)か
+	 *
+	 * @param[in]		pBuf		受信データ(3byte以上)
+	 */
+	bool _is_frame_head(const uint8_t* pBuf)
+	{
+		return (pBuf[0] == 0x00) && (pBuf[1] == 0x00) && (pBuf[2] == 0xff);
+	}
+
+	/**
+	 * 受信データの先頭を合わせ直す
+	 *
+	 * 受信済みのLen byteを1byteずつずらしながら読み足し、先頭がbMatch()を満たすまで #RESYNC_MAX byte読み飛ばす.
+	 * 読み飛ばした分は捨てる.
+	 *
+	 * @param[in,out]	pBuf		受信済みのデータ(Len byte)
+	 * @param[in]		Len			pBufの長さ
+	 * @param[in]		bMatch		先頭の判定
+	 * @retval			true		合った(pBufに入っている)
+	 * @retval			false		合わなかった(読み込めないか、上限まで読み飛ばした)
+	 */
+	bool _resync(uint8_t* pBuf, uint16_t Len, bool (*bMatch)(const uint8_t*))
+	{
+		for(uint16_t skip = 1; skip <= RESYNC_MAX; skip++) {
+			memmove(pBuf, pBuf + 1, Len - 1);
+			if(_port_read(pBuf + Len - 1, 1) != 1) {
+				break;
+			}
+			if(bMatch(pBuf)) {
+				LOGD("resync : skip %d\n", skip);
+				if(s_pCurStat) {
+					s_pCurStat->Resync++;
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * 何度送っても同じ結果になるコマンドか
+	 *
+	 * レスポンスを受け取れなかったときに送り直してよいものだけtrueを返す.
+	 *
+	 * @param[in]		Code		コマンドコード
+	 */
+	bool _idempotent(uint8_t Code)
+	{
+		switch(Code) {
+		case 0x00:		//Diagnose
+		case 0x02:		//GetFirmwareVersion
+		case 0x04:		//GetGeneralStatus
+		case 0x06:		//ReadRegister
+		case 0x08:		//WriteRegister
+		case 0x12:		//SetParameters
+		case 0x32:		//RFConfiguration
+		case 0x4a:		//InListPassiveTarget
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	/**
+	 * 搬送波を出すコマンドなら、出し始めた時刻を記録する
+	 *
+	 * RC-S620/Sはこれらのコマンドで搬送波を出し、#NfcPcd::rfOff() まで出し続ける.
+	 *
+	 * @param[in]		Code		コマンドコード
+	 */
+	void _rf_on(uint8_t Code)
+	{
+		switch(Code) {
+		case 0x40:		//InDataExchange
+		case 0x42:		//InCommunicateThru
+		case 0x46:		//InJumpForPSL
+		case 0x4a:		//InListPassiveTarget
+		case 0x56:		//InJumpForDEP
+		case 0xa0:		//CommunicateThruEx
+			if(!s_bRfOn) {
+				s_bRfOn = true;
+				s_RfOnTime = nowUsec();
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	/**
+	 * 搬送波が止まったことを記録する(#NfcPcd::rfOff() / #NfcPcd::reset())
+	 */
+	void _rf_off()
+	{
+		if(s_bRfOn) {
+			s_RfOnUsec += nowUsec() - s_RfOnTime;
+			s_bRfOn = false;
+		}
 	}
 
 }
@@ -88,18 +483,25 @@ namespace {
 /**
  * シリアルポートオープン
  *
+ * @param[in]	pPath		デバイスパス(0ならデフォルト)
+ * @param[in]	Baud		ホスト側の通信速度[bps](PCDがすでにその速度になっているときに指定する)
+ *
  * @retval	true		成功
  * @retval	false		失敗
  */
-bool NfcPcd::portOpen()
+bool NfcPcd::portOpen(const char* pPath/*=0*/, uint32_t Baud/*=DEFAULT_BAUD*/)
 {
 	if(m_bOpened) {
 		return false;
 	}
-	s_SendBuf[0] = 0x00;
-	s_SendBuf[1] = 0x00;
-	s_SendBuf[2] = 0xff;
-	m_bOpened = DevAccess::open();
+	s_FrmHead[0] = 0x00;
+	s_FrmHead[1] = 0x00;
+	s_FrmHead[2] = 0xff;
+	m_bOpened = DevAccess::open(pPath);
+	m_BaudRate = DEFAULT_BAUD;
+	if(m_bOpened && (Baud != DEFAULT_BAUD) && DevAccess::setBaudRate(Baud)) {
+		m_BaudRate = Baud;
+	}
 	return m_bOpened;
 }
 
@@ -119,98 +521,92 @@ void NfcPcd::portClose()
 /**
  * デバイス初期化
  *
+ * Resetしてから、 #setRfConfig() のRFConfigurationを全部送る.
+ *
+ * bWarmがtrueで、このスレッドで前に初期化したRFConfigurationが残っているはずなら、
+ * ResetせずにGetGeneralStatusで応答を確かめ、前回から変わった項目だけを送る(ウォームスタート).
+ * RC-S620/SはRFConfigurationを読み出せないので、前回送った値と比べる.
+ * 応答がなければResetからやり直す.
+ *
+ * @param[in]	bWarm		ウォームスタートを試すかどうか
+ *
  * @retval	true		初期化成功(=使用可能)
  * @retval	false		初期化失敗
  * @attention			初期化失敗時には、#rfOff()を呼び出すこと
+ * @attention			ウォームスタートは、PCDが前回の初期化から電源断やResetをしていないときだけ使うこと.
+ * 						起動し直したPCDも115200bpsならGetGeneralStatusに応答するので見分けられず、
+ * 						失ったRFConfigurationを送り直さない(起動し直したと分かるのは、通信速度を上げていて応答がないときだけ).
  */
-bool NfcPcd::init()
+bool NfcPcd::init(bool bWarm/*=false*/)
 {
 	//LOGD("%s", __PRETTY_FUNCTION__);
 
 	bool ret;
-	uint16_t res_len;
 
 	sendAck();
 
-	ret = reset();
-	if(!ret) {
-		return false;
+	bool bAll = true;
+	if(bWarm && s_bApplied) {
+		uint8_t status[5];
+		if(getGeneralStatus(status)) {
+			bAll = false;
+			if(status[GGS_FIELD]) {
+				rfOff();
+			}
+		} else if(m_BaudRate != DEFAULT_BAUD) {
+			//PCDが起動し直していれば、起動時の速度に戻っている
+			DevAccess::setBaudRate(DEFAULT_BAUD);
+			m_BaudRate = DEFAULT_BAUD;
+			sendAck();
+		}
 	}
+	if(bAll) {
+		ret = reset();
+		if(!ret) {
+			return false;
+		}
+	}
+	const RfConfig& cfg = s_RfConfig;
 
 	// RF通信のT/O
-	s_NormalFrmBuf[0] = 0xd4;
-	s_NormalFrmBuf[1] = 0x32;
-	s_NormalFrmBuf[2] = 0x02;		// T/O
-	s_NormalFrmBuf[3] = 0x00;		// RFU
-	s_NormalFrmBuf[4] = 0x00;		// ATR_RES : no timeout
-	s_NormalFrmBuf[5] = 0x00;		// 非DEP通信時 : no timeout
-	ret = sendCmd(s_NormalFrmBuf, 6, s_ResponseBuf, &res_len);
-	if(!ret || (res_len != RESHEAD_LEN)) {
-		LOGE("d4 32 02\n");
-		return false;
+	if(bAll || std::memcmp(cfg.Timeout, s_Applied.Timeout, sizeof(cfg.Timeout))) {
+		ret = rfConfiguration(0x02, cfg.Timeout, sizeof(cfg.Timeout));
+		if(!ret) {
+			LOGE("d4 32 02\n");
+			return false;
+		}
 	}
 
 	// Target捕捉時のRF通信リトライ回数
-	s_NormalFrmBuf[2] = 0x05;		// Retry
-	s_NormalFrmBuf[3] = 0x00;		// ATR_REQ/RES : only once
-	s_NormalFrmBuf[4] = 0x00;		// PSL_REQ/RES : only once
-	s_NormalFrmBuf[5] = 0x00;		// InListPassiveTarget : only once
-	ret = sendCmd(s_NormalFrmBuf, 6, s_ResponseBuf, &res_len);
-	if(!ret || (res_len != RESHEAD_LEN)) {
-		LOGE("d4 32 05(%d)%d\n", ret, res_len);
-		return false;
+	if(bAll || std::memcmp(cfg.Retry, s_Applied.Retry, sizeof(cfg.Retry))) {
+		ret = rfConfiguration(0x05, cfg.Retry, sizeof(cfg.Retry));
+		if(!ret) {
+			LOGE("d4 32 05\n");
+			return false;
+		}
 	}
 
 	// RF出力ONからTargetID取得コマンド送信までの追加ウェイト時間
-	s_NormalFrmBuf[2] = 0x81;		// wait
-	s_NormalFrmBuf[3] = 0xb7;		// 0.1 x prm + 5 + 0.7 [ms]
-									// 0xb7は、サンプルソースの値
-	ret = sendCmd(s_NormalFrmBuf, 4, s_ResponseBuf, &res_len);
-	if(!ret || (res_len != RESHEAD_LEN)) {
-		LOGE("d4 32 81(%d)%d\n", ret, res_len);
-		return false;
+	if(bAll || (cfg.Wait != s_Applied.Wait)) {
+		ret = rfConfiguration(0x81, &cfg.Wait, 1);
+		if(!ret) {
+			LOGE("d4 32 81\n");
+			return false;
+		}
 	}
 
 	// DEPターゲットでのタイムアウト
-	s_NormalFrmBuf[2] = 0x82;		// DEP Target Timeout
-	s_NormalFrmBuf[3] = 0x08;		// gbyAtrResTo
-										// 00h :    302us
-										// 01h :    604us
-										// 02h :   1.208ms
-										// 03h :   2.417ms
-										// 04h :   4.833ms
-										// 05h :   9.666ms
-										// 06h :  19.332ms
-										// 07h :  38.664ms
-										// 08h :  77.329ms ★
-										// 09h : 154.657ms
-										// 0ah : 309.314ms
-										// 0bh : 618.629ms
-										// 0ch :   1.237s
-										// 0dh :   2.474s
-										// 0eh :   4.949s
-	s_NormalFrmBuf[4] = 0x01;		// gbyRtox
-										// RWT x gbyRtox
-	s_NormalFrmBuf[5] = 0x08;		// gbyTargetStoTo
-										// 00h : 951us
-										// 01h : 1.1ms
-										// 02h : 1.4ms
-										// 03h : 2.0ms
-										// 04h : 3.2ms
-										// 05h : 5.6ms
-										// 06h : 10.4ms
-										// 07h : 20.1ms
-										// 08h : 39.4ms ★
-										// 09h : 78.1ms
-										// 0ah : 155.4ms
-										// 0bh : 310.0ms
-										// 0ch : 619.sms
-										// 0dh : 1.237s
-										// 0eh : 2.474s
-	ret = sendCmd(s_NormalFrmBuf, 6, s_ResponseBuf, &res_len);
-	if(!ret || (res_len != RESHEAD_LEN)) {
-		LOGE("d4 32 82(%d)%d\n", ret, res_len);
-		//return false;
+	bool bDep = bAll || std::memcmp(cfg.DepTimeout, s_Applied.DepTimeout, sizeof(cfg.DepTimeout));
+	s_Applied = cfg;
+	s_bApplied = true;
+	if(bDep) {
+		ret = rfConfiguration(0x82, cfg.DepTimeout, sizeof(cfg.DepTimeout));
+		if(!ret) {
+			LOGE("d4 32 82\n");
+			//失敗しても続けるが、次のウォームスタートで送り直す
+			std::memset(s_Applied.DepTimeout, 0xff, sizeof(s_Applied.DepTimeout));
+			ret = true;
+		}
 	}
 
 
@@ -231,6 +627,30 @@ bool NfcPcd::init()
 }
 
 
+/**
+ * 初期化で送るRFConfigurationの設定
+ *
+ * 次の #init() から使う. スレッドごとに持ち、#portClose() しても残る.
+ *
+ * @param[in]	cfg		設定
+ */
+void NfcPcd::setRfConfig(const RfConfig& cfg)
+{
+	s_RfConfig = cfg;
+}
+
+
+/**
+ * 初期化で送るRFConfigurationの設定取得
+ *
+ * @return		設定
+ */
+const NfcPcd::RfConfig& NfcPcd::rfConfig()
+{
+	return s_RfConfig;
+}
+
+
 /**
  * 搬送波停止
  *
@@ -252,6 +672,7 @@ bool NfcPcd::rfOff()
 		LOGE("rfOff ret=%d\n", ret);
 		return false;
 	}
+	_rf_off();
 
 	return true;
 }
@@ -273,10 +694,9 @@ bool NfcPcd::rfConfiguration(uint8_t cmd, const uint8_t* pCommand, uint8_t Comma
 	s_NormalFrmBuf[0] = 0xd4;
 	s_NormalFrmBuf[1] = 0x32;		//RFConfiguration
 	s_NormalFrmBuf[2] = cmd;
-	memcpy(s_NormalFrmBuf + 3, pCommand, CommandLen);
 
 	uint16_t res_len;
-	bool ret = sendCmd(s_NormalFrmBuf, 3 + CommandLen, s_ResponseBuf, &res_len);
+	bool ret = sendCmd(s_NormalFrmBuf, 3, pCommand, CommandLen, s_ResponseBuf, &res_len);
 	if(!ret || (res_len != RESHEAD_LEN)) {
 		LOGE("rfConfiguration ret=%d\n", ret);
 		return false;
@@ -299,6 +719,7 @@ bool NfcPcd::reset()
 	s_NormalFrmBuf[0] = 0xd4;
 	s_NormalFrmBuf[1] = 0x18;		//Reset
 	s_NormalFrmBuf[2] = 0x01;
+	s_bApplied = false;
 
 	uint16_t res_len;
 	bool ret = sendCmd(s_NormalFrmBuf, 3, s_ResponseBuf, &res_len);
@@ -310,11 +731,109 @@ bool NfcPcd::reset()
 	// execute
 	sendAck();
 	msleep(10);
+	//Resetで搬送波も止まる
+	_rf_off();
+
+	return true;
+}
+
+
+/**
+ * SetSerialBaudRate
+ *
+ * PCDが応答したらACKを返し、それを送り終えてからホスト側も切り替える.
+ *
+ * @param[in]	Baud		通信速度[bps]
+ *
+ * @retval		true			成功
+ * @retval		false			失敗(通信速度は変わっていない)
+ */
+bool NfcPcd::setSerialBaudRate(uint32_t Baud)
+{
+	//LOGD("%s", __PRETTY_FUNCTION__);
+
+	if(Baud == m_BaudRate) {
+		return true;
+	}
+
+	uint8_t br = 0;
+	while((br < SERIAL_BAUD_NUM) && (SERIAL_BAUD[br] != Baud)) {
+		br++;
+	}
+	if((br == SERIAL_BAUD_NUM) || !DevAccess::checkBaudRate(Baud)) {
+		LOGE("setSerialBaudRate : not supported(%u)\n", Baud);
+		return false;
+	}
+
+	s_NormalFrmBuf[0] = 0xd4;
+	s_NormalFrmBuf[1] = 0x10;		//SetSerialBaudRate
+	s_NormalFrmBuf[2] = br;
+
+	uint16_t res_len;
+	bool ret = sendCmd(s_NormalFrmBuf, 3, s_ResponseBuf, &res_len);
+	if(!ret || (res_len != RESHEAD_LEN)) {
+		LOGE("setSerialBaudRate ret=%d\n", ret);
+		return false;
+	}
+
+	// execute
+	sendAck();
+	if(!DevAccess::setBaudRate(Baud)) {
+		//PCDだけ切り替わってしまった
+		LOGE("setSerialBaudRate : host fail\n");
+		return false;
+	}
+	m_BaudRate = Baud;
 
 	return true;
 }
 
 
+/**
+ * 使える一番速い通信速度に切り替える
+ *
+ * MaxBaud以下でPCDとホストの両方が対応している速度を速い方から試す.
+ * 切り替えた後はGetFirmwareVersionが通ることを確認する.
+ * 通らなければ、PCDは切り替わらなかったとみなしてホストを元の速度に戻し、そこで止める.
+ * 元の速度でも通らなければ、PCDとは通信できない.
+ *
+ * @param[in]	MaxBaud		上限の通信速度[bps]
+ * @return		切り替えた後の通信速度[bps](0:PCDと通信できなくなった)
+ */
+uint32_t NfcPcd::negotiateBaudRate(uint32_t MaxBaud)
+{
+	for(int i = SERIAL_BAUD_NUM - 1; i >= 0; i--) {
+		uint32_t baud = SERIAL_BAUD[i];
+		if((baud > MaxBaud) || (baud <= m_BaudRate)) {
+			continue;
+		}
+		uint32_t prev = m_BaudRate;
+		if(!setSerialBaudRate(baud)) {
+			continue;
+		}
+
+		if(getFirmwareVersion(0)) {
+			LOGD("baud rate : %u\n", baud);
+			break;
+		}
+
+		LOGE("negotiateBaudRate : no response(%u)\n", baud);
+		if(!DevAccess::setBaudRate(prev)) {
+			return 0;
+		}
+		m_BaudRate = prev;
+		sendAck();
+		if(!getFirmwareVersion(0)) {
+			LOGE("negotiateBaudRate : no response(%u)\n", prev);
+			return 0;
+		}
+		break;
+	}
+
+	return m_BaudRate;
+}
+
+
 /**
  * Diagnose
  *
@@ -333,17 +852,46 @@ bool NfcPcd::diagnose(uint8_t cmd, const uint8_t* pCommand, uint8_t CommandLen,
 	s_NormalFrmBuf[0] = 0xd4;
 	s_NormalFrmBuf[1] = 0x00;			//Diagnose
 	s_NormalFrmBuf[2] = cmd;
-	memcpy(s_NormalFrmBuf + 3, pCommand, CommandLen);
 	
 	uint16_t res_len;
-	bool ret = sendCmd(s_NormalFrmBuf, 3 + CommandLen, s_ResponseBuf, &res_len);
+	bool ret = sendCmd(s_NormalFrmBuf, 3, pCommand, CommandLen, s_ResponseBuf, &res_len);
 	if(!ret || (res_len < RESHEAD_LEN)) {
 		LOGE("diagnose ret=%d/%d\n", ret, res_len);
 		return false;
 	}
 	
 	*pResponseLen = res_len - RESHEAD_LEN;
-	memcpy(pResponse, s_ResponseBuf + RESHEAD_LEN, *pResponseLen);
+	memmove(pResponse, s_ResponseBuf + RESHEAD_LEN, *pResponseLen);
+
+	return true;
+}
+
+
+/**
+ * Diagnose(Attention Request Test)
+ *
+ * 活性化したターゲットがまだ応答するかを調べる.
+ * ステータスはレスポンスバッファの中で見るので、コピーしない.
+ *
+ * @retval		true			ターゲットが応答した
+ * @retval		false			応答なし、または失敗
+ */
+bool NfcPcd::attentionRequest()
+{
+	s_NormalFrmBuf[0] = 0xd4;
+	s_NormalFrmBuf[1] = 0x00;			//Diagnose
+	s_NormalFrmBuf[2] = 0x06;			//Attention Request Test
+
+	uint16_t res_len;
+	bool ret = sendCmd(s_NormalFrmBuf, 3, s_ResponseBuf, &res_len);
+	if(!ret || (res_len < RESHEAD_LEN + 1)) {
+		LOGE("attentionRequest ret=%d/%d\n", ret, res_len);
+		return false;
+	}
+	if(s_ResponseBuf[RESHEAD_LEN] != 0x00) {
+		LOGD("attentionRequest status=%02x\n", s_ResponseBuf[RESHEAD_LEN]);
+		return false;
+	}
 
 	return true;
 }
@@ -385,10 +933,9 @@ bool NfcPcd::writeRegister(const uint8_t* pCommand, uint8_t CommandLen)
 
 	s_NormalFrmBuf[0] = 0xd4;
 	s_NormalFrmBuf[1] = 0x08;
-	memcpy(s_NormalFrmBuf + 2, pCommand, CommandLen);
 
 	uint16_t res_len;
-	bool ret = sendCmd(s_NormalFrmBuf, 2 + CommandLen, s_ResponseBuf, &res_len);
+	bool ret = sendCmd(s_NormalFrmBuf, 2, pCommand, CommandLen, s_ResponseBuf, &res_len);
 	if(!ret || (res_len < RESHEAD_LEN + CommandLen/2)) {
 		LOGE("writeReg ret=%d res_len=%d\n", ret, res_len);
 	} else {
@@ -506,10 +1053,9 @@ bool NfcPcd::communicateThruEx(
 
 	s_NormalFrmBuf[0] = 0xd4;
 	s_NormalFrmBuf[1] = 0xa0;		//CommunicateThruEX
-	memcpy(s_NormalFrmBuf + 2, pCommand, CommandLen);
 
 	uint16_t res_len;
-	bool ret = sendCmd(s_NormalFrmBuf, 2 + CommandLen, s_ResponseBuf, &res_len);
+	bool ret = sendCmd(s_NormalFrmBuf, 2, pCommand, CommandLen, s_ResponseBuf, &res_len);
 	if(!ret || (res_len < RESHEAD_LEN+1)) {
 		LOGE("communicateThruEx ret=%d\n", ret);
 		return false;
@@ -524,7 +1070,7 @@ bool NfcPcd::communicateThruEx(
 		}
 		//Statusは返さない
 		*pResponseLen = (uint8_t)(s_ResponseBuf[3] - 1);
-		memcpy(pResponse, s_ResponseBuf + 4, *pResponseLen);
+		memmove(pResponse, s_ResponseBuf + 4, *pResponseLen);	//pResponseがresponseBuf()のこともあるので重なってよいコピー
 	}
 
 	return true;
@@ -556,13 +1102,9 @@ bool NfcPcd::communicateThruEx(
 	s_NormalFrmBuf[1] = 0xa0;		//CommunicateThruEX
 	s_NormalFrmBuf[2] = l16(Timeout);
 	s_NormalFrmBuf[3] = h16(Timeout);
-	if(CommandLen) {
-		memcpy(s_NormalFrmBuf + 4, pCommand, CommandLen);
-		CommandLen += 4;
-	}
 
 	uint16_t res_len;
-	bool ret = sendCmd(s_NormalFrmBuf, CommandLen, s_ResponseBuf, &res_len);
+	bool ret = sendCmd(s_NormalFrmBuf, (CommandLen) ? 4 : 0, pCommand, CommandLen, s_ResponseBuf, &res_len);
 	if(!ret || (res_len < RESHEAD_LEN+1)) {
 		LOGE("communicateThruEx ret=%d\n", ret);
 		return false;
@@ -577,8 +1119,52 @@ bool NfcPcd::communicateThruEx(
 			return false;
 		}
 		*pResponseLen = (uint8_t)(s_ResponseBuf[POS_RESDATA+1] - 1);
-		memcpy(pResponse, s_ResponseBuf + RESHEAD_LEN + 2, *pResponseLen);
+		memmove(pResponse, s_ResponseBuf + RESHEAD_LEN + 2, *pResponseLen);
+	}
+
+	return true;
+}
+
+
+/**
+ * CommunicateThruEX(複数のレスポンスを連結のまま返す)
+ *
+ * タイムスロットを指定したFeliCaのPollingのように、複数のカードが応答するコマンドに使う.
+ * レスポンスはそれぞれ先頭に長さ(LEN)がついたまま、受信した順に並ぶ.
+ *
+ * @param[in]	Timeout			タイムアウト値[msec]
+ * @param[in]	pCommand		送信するコマンド
+ * @param[in]	CommandLen		pCommandの長さ
+ * @param[out]	pResponse		レスポンス(LEN含む, サイズ:DATA_MAX)
+ * @param[out]	pResponseLen	pResponseの長さ
+ *
+ * @retval		true			成功
+ * @retval		false			失敗(応答なしを含む)
+ *
+ * @note		-# #Timeoutは往復分の時間を設定すること.
+ */
+bool NfcPcd::communicateThruExAll(
+			uint16_t Timeout,
+			const uint8_t* pCommand, uint8_t CommandLen,
+			uint8_t* pResponse, uint16_t* pResponseLen)
+{
+	s_NormalFrmBuf[0] = 0xd4;
+	s_NormalFrmBuf[1] = 0xa0;		//CommunicateThruEX
+	s_NormalFrmBuf[2] = l16(Timeout);
+	s_NormalFrmBuf[3] = h16(Timeout);
+
+	uint16_t res_len;
+	bool ret = sendCmd(s_NormalFrmBuf, 4, pCommand, CommandLen, s_ResponseBuf, &res_len);
+	if(!ret || (res_len < RESHEAD_LEN+1)) {
+		LOGE("communicateThruExAll ret=%d\n", ret);
+		return false;
+	}
+	if(s_ResponseBuf[POS_RESDATA] != 0x00) {
+		//Status(0x01:応答なし)
+		return false;
 	}
+	*pResponseLen = res_len - (RESHEAD_LEN + 1);
+	memmove(pResponse, s_ResponseBuf + RESHEAD_LEN + 1, *pResponseLen);
 
 	return true;
 }
@@ -635,10 +1221,11 @@ bool NfcPcd::_inJump(uint8_t Cmd, DepInitiatorParam* pParam)
 		LOGE("inJumpForDep ret=%d/len=%d\n", ret, res_len);
 		return false;
 	}
+	m_TargetNo = 1;
 
 	if(pParam->pResponse) {
 		pParam->ResponseLen = (uint8_t)(res_len - (RESHEAD_LEN + 1));
-		memcpy(pParam->pResponse, s_ResponseBuf + RESHEAD_LEN+1, pParam->ResponseLen);
+		memmove(pParam->pResponse, s_ResponseBuf + RESHEAD_LEN+1, pParam->ResponseLen);
 	}
 
 	return true;
@@ -676,24 +1263,55 @@ bool NfcPcd::inJumpForPsl(DepInitiatorParam* pParam)
  * @param[in]	InitLen			pInitDataの長さ
  * @param[out]	ppTgData		InListPassiveTargeの戻り値(内部バッファを返す)
  * @param[out]	pTgLen			*ppTgDataの長さ
+ * @param[in]	MaxTg			取得する最大ターゲット数(1～#MAX_TG)
  *
- * @retval		true			成功
+ * @retval		true			成功(1つ以上取得した)
  * @retval		false			失敗
+ *
+ * @note		- *ppTgDataはTg=1のターゲットから始まる. 2つめ以降は#listedTarget()で取り出す.
+ * 				- InDataExchangeの相手はTg=1になる(#setTargetNo()).
  */
 bool NfcPcd::inListPassiveTarget(
 			const uint8_t* pInitData, uint8_t InitLen,
-			uint8_t** ppTgData, uint8_t* pTgLen)
+			uint8_t** ppTgData, uint8_t* pTgLen,
+			uint8_t MaxTg/*=1*/)
 {
+	s_ListNum = 0;
+	if((MaxTg == 0) || (MaxTg > MAX_TG)) {
+		LOGE("bad MaxTg : %d\n", MaxTg);
+		return false;
+	}
+
 	uint16_t responseLen;
 	s_NormalFrmBuf[0] = 0xd4;
 	s_NormalFrmBuf[1] = 0x4a;				//InListPassiveTarget
-	s_NormalFrmBuf[2] = 0x01;
-	memcpy(s_NormalFrmBuf + 3, pInitData, InitLen);
+	s_NormalFrmBuf[2] = MaxTg;
+
+	bool ret = sendCmd(s_NormalFrmBuf, 3, pInitData, InitLen, s_ResponseBuf, &responseLen);
+	uint8_t num = s_ResponseBuf[POS_RESDATA];		//NbTg
+	if(!ret || (num == 0) || (num > MaxTg)) {
+		return false;
+	}
 
-	bool ret = sendCmd(s_NormalFrmBuf, 3+InitLen, s_ResponseBuf, &responseLen);
-	if(!ret || s_ResponseBuf[POS_RESDATA] != 0x01) {	//NbTg==1
+	//ターゲットごとの位置
+	uint16_t pos = POS_RESDATA + 1;
+	for(uint8_t i = 0; i < num; i++) {
+		uint16_t len = _target_len(pInitData[0], s_ResponseBuf + pos, responseLen - pos);
+		if(len == 0) {
+			LOGE("bad target(%d)\n", i + 1);
+			break;
+		}
+		s_ListPos[i] = pos;
+		s_ListLen[i] = static_cast<uint8_t>(len);
+		s_ListNum++;
+		pos += len;
+	}
+	if(s_ListNum == 0) {
+		//使えるターゲットがない
 		return false;
 	}
+	m_TargetNo = 1;
+
 	*ppTgData = s_ResponseBuf;
 	*pTgLen = static_cast<uint8_t>(responseLen);
 
@@ -701,6 +1319,39 @@ bool NfcPcd::inListPassiveTarget(
 }
 
 
+/**
+ * 最後のInListPassiveTargetで取得したターゲット数
+ *
+ * @return		ターゲット数(失敗していれば0)
+ */
+uint8_t NfcPcd::listedTargetNum()
+{
+	return s_ListNum;
+}
+
+
+/**
+ * 最後のInListPassiveTargetで取得したターゲットのデータ
+ *
+ * InListPassiveTargetのレスポンスのうち、1ターゲット分(Tgから)を返す.
+ *
+ * @param[in]	Index			ターゲット番号(0～#listedTargetNum()-1)
+ * @param[out]	pLen			データ長(Tg含む)
+ * @return		データ(0:Indexが範囲外)
+ *
+ * @attention	内部バッファを指すので、次のコマンドを送るまでに使うこと.
+ */
+const uint8_t* NfcPcd::listedTarget(uint8_t Index, uint8_t* pLen)
+{
+	if(Index >= s_ListNum) {
+		*pLen = 0;
+		return 0;
+	}
+	*pLen = s_ListLen[Index];
+	return s_ResponseBuf + s_ListPos[Index];
+}
+
+
 /**
  * InDataExchange
  *
@@ -725,21 +1376,20 @@ bool NfcPcd::inDataExchange(
 
 	s_NormalFrmBuf[0] = 0xd4;
 	s_NormalFrmBuf[1] = 0x40;			//InDataExchange
-	s_NormalFrmBuf[2] = 0x01;			//Tg
+	s_NormalFrmBuf[2] = m_TargetNo;		//Tg
 	if(bCoutinue) {
 		s_NormalFrmBuf[2] |= 0x40;	//MI
 	}
-	memcpy(s_NormalFrmBuf + 3, pCommand, CommandLen);
 
 	uint16_t res_len;
-	bool ret = sendCmd(s_NormalFrmBuf, 3 + CommandLen, s_ResponseBuf, &res_len);
+	bool ret = sendCmd(s_NormalFrmBuf, 3, pCommand, CommandLen, s_ResponseBuf, &res_len);
 	if(!ret || (res_len < RESHEAD_LEN+1) || (s_ResponseBuf[POS_RESDATA] != 0x00)) {
 		LOGE("inDataExchange ret=%d / len=%d / code=%02x\n", ret, res_len, s_ResponseBuf[POS_RESDATA]);
 		return false;
 	}
 
 	*pResponseLen = res_len - (RESHEAD_LEN+1);
-	memcpy(pResponse, s_ResponseBuf + RESHEAD_LEN+1, *pResponseLen);
+	memmove(pResponse, s_ResponseBuf + RESHEAD_LEN+1, *pResponseLen);
 
 	return true;
 }
@@ -762,10 +1412,9 @@ bool NfcPcd::inCommunicateThru(
 {
 	s_NormalFrmBuf[0] = 0xd4;
 	s_NormalFrmBuf[1] = 0x42;			//InCommunicateThru
-	memcpy(s_NormalFrmBuf + 2, pCommand, CommandLen);
 
 	uint16_t res_len;
-	bool ret = sendCmd(s_NormalFrmBuf, 2 + CommandLen, s_ResponseBuf, &res_len);
+	bool ret = sendCmd(s_NormalFrmBuf, 2, pCommand, CommandLen, s_ResponseBuf, &res_len);
 //	for(int i=0; i<res_len; i++) {
 //		LOGD("%02x \n", s_ResponseBuf[i]);
 //	}
@@ -775,7 +1424,7 @@ bool NfcPcd::inCommunicateThru(
 	}
 
 	*pResponseLen = res_len - (RESHEAD_LEN+1);
-	memcpy(pResponse, s_ResponseBuf + RESHEAD_LEN+1, *pResponseLen);
+	memmove(pResponse, s_ResponseBuf + RESHEAD_LEN+1, *pResponseLen);
 
 	return true;
 }
@@ -943,12 +1592,9 @@ bool NfcPcd::tgSetGeneralBytes(const TargetParam* pParam)
 
 	s_NormalFrmBuf[0] = 0xd4;
 	s_NormalFrmBuf[1] = 0x92;				//TgSetGeneralBytes
-	if(pParam->GbLen) {
-		memcpy(s_NormalFrmBuf + 2, pParam->pGb, pParam->GbLen);
-	}
 
 	uint16_t res_len;
-	bool ret = sendCmd(s_NormalFrmBuf, 2 + pParam->GbLen, s_ResponseBuf, &res_len);
+	bool ret = sendCmd(s_NormalFrmBuf, 2, pParam->pGb, pParam->GbLen, s_ResponseBuf, &res_len);
 	if(!ret || (res_len < RESHEAD_LEN+1) || (s_ResponseBuf[POS_RESDATA] != 0x00)) {
 		LOGE("tgSetGeneralBytes ret=%d / len=%d / code=%02x\n", ret, res_len, s_ResponseBuf[POS_RESDATA]);
 		return false;
@@ -985,11 +1631,9 @@ bool NfcPcd::tgResponseToInitiator(
 	//応答
 //ここは練り直した方がいい
 	s_NormalFrmBuf[len++] = 0xd5;
-	memcpy(&(s_NormalFrmBuf[len]), pData, DataLen);
-	len += DataLen;
 
 	uint16_t res_len;
-	bool ret = sendCmd(s_NormalFrmBuf, len, s_ResponseBuf, &res_len);
+	bool ret = sendCmd(s_NormalFrmBuf, len, pData, DataLen, s_ResponseBuf, &res_len);
 	if(!ret || (res_len != 3) || s_ResponseBuf[POS_RESDATA] != 0x00) {
 		LOGE("tgResponseToInitiator ret=%d\n", ret);
 		return false;
@@ -1029,7 +1673,7 @@ bool NfcPcd::tgGetInitiatorCommand(uint8_t* pResponse, uint8_t* pResponseLen)
 	}
 
 	*pResponseLen = res_len - (RESHEAD_LEN+1);
-	memcpy(pResponse, s_ResponseBuf + RESHEAD_LEN+1, *pResponseLen);
+	memmove(pResponse, s_ResponseBuf + RESHEAD_LEN+1, *pResponseLen);
 
 	return true;
 }
@@ -1059,7 +1703,7 @@ bool NfcPcd::tgGetData(uint8_t* pCommand, uint8_t* pCommandLen)
 	}
 
 	*pCommandLen = res_len - (RESHEAD_LEN+1);
-	memcpy(pCommand, s_ResponseBuf + RESHEAD_LEN+1, *pCommandLen);
+	memmove(pCommand, s_ResponseBuf + RESHEAD_LEN+1, *pCommandLen);
 
 	return true;
 }
@@ -1085,10 +1729,9 @@ bool NfcPcd::tgSetData(const uint8_t* pResponse, uint8_t ResponseLen)
 
 	s_NormalFrmBuf[0] = 0xd4;
 	s_NormalFrmBuf[1] = 0x8e;			//TgSetData
-	memcpy(s_NormalFrmBuf + 2, pResponse, ResponseLen);
 
 	uint16_t res_len;
-	bool ret = sendCmd(s_NormalFrmBuf, 2 + ResponseLen, s_ResponseBuf, &res_len);
+	bool ret = sendCmd(s_NormalFrmBuf, 2, pResponse, ResponseLen, s_ResponseBuf, &res_len);
 	if(!ret || (res_len != RESHEAD_LEN+1) || (s_ResponseBuf[POS_RESDATA] != 0x00)) {
 		LOGE("tgSetData ret=%d / len=%d / code=%02x\n", ret, res_len, s_ResponseBuf[POS_RESDATA]);
 		return false;
@@ -1099,6 +1742,226 @@ bool NfcPcd::tgSetData(const uint8_t* pResponse, uint8_t ResponseLen)
 
 
 
+/////////////////////////////////////////////////////////////////////////
+// キャプチャ
+/////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * キャプチャ開始
+ *
+ * 呼び出したスレッドのPCDとのやりとりを、nfccapture.hの形式でファイルに書く.
+ * #portOpen()の前に呼べば、初期化からキャプチャできる.
+ *
+ * @param[in]	pPath		出力ファイルのパス
+ *
+ * @retval		true		成功
+ * @retval		false		失敗(キャプチャ中, ファイルが開けない)
+ */
+bool NfcPcd::startCapture(const char* pPath)
+{
+	if(s_pCapture) {
+		LOGE("already capturing\n");
+		return false;
+	}
+	s_pCapture = fopen(pPath, "wb");
+	if(!s_pCapture) {
+		LOGE("cannot open capture : %s\n", pPath);
+		return false;
+	}
+
+	uint8_t head[NfcCapture::FILEHEAD_LEN];
+	std::memcpy(head, NfcCapture::MAGIC, sizeof(NfcCapture::MAGIC));
+	head[4] = l16(NfcCapture::VERSION);
+	head[5] = h16(NfcCapture::VERSION);
+	head[6] = 0x00;
+	head[7] = 0x00;
+	fwrite(head, 1, sizeof(head), s_pCapture);
+	s_CaptureTime = nowUsec();
+
+	return true;
+}
+
+
+/**
+ * キャプチャ終了
+ */
+void NfcPcd::stopCapture()
+{
+	if(s_pCapture) {
+		fclose(s_pCapture);
+		s_pCapture = 0;
+	}
+}
+
+
+/////////////////////////////////////////////////////////////////////////
+// 統計
+/////////////////////////////////////////////////////////////////////////
+
+
+/**
+ * 統計取得(全コマンド)
+ *
+ * 呼び出したスレッドでsendCmd()したものだけが入っている.
+ *
+ * @param[out]	ppStat		統計の配列(内部バッファを返す)
+ * @return		*ppStatの要素数
+ */
+uint8_t NfcPcd::getStat(const CmdStat** ppStat)
+{
+	*ppStat = s_Stat;
+	return s_StatNum;
+}
+
+
+/**
+ * 統計取得(コマンド指定)
+ *
+ * @param[in]	Code		コマンドコード(0xd4の次のbyte)
+ * @return		統計(0:まだ送信していない)
+ */
+const NfcPcd::CmdStat* NfcPcd::getStat(uint8_t Code)
+{
+	for(uint8_t i = 0; i < s_StatNum; i++) {
+		if(s_Stat[i].Code == Code) {
+			return &s_Stat[i];
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * 統計クリア
+ */
+void NfcPcd::clearStat()
+{
+	s_StatNum = 0;
+	s_pCurStat = 0;
+	s_RfOnUsec = 0;
+	s_RfOnTime = nowUsec();
+}
+
+
+/**
+ * 搬送波を出していた時間
+ *
+ * 呼び出したスレッドで、搬送波を出すコマンドを送ってから #rfOff() するまでの時間の合計.
+ * 出している最中なら、今までの分も含む.
+ *
+ * @return		時間[usec](#clearStat()からの分)
+ */
+uint64_t NfcPcd::rfOnUsec()
+{
+	uint64_t usec = s_RfOnUsec;
+	if(s_bRfOn) {
+		usec += nowUsec() - s_RfOnTime;
+	}
+	return usec;
+}
+
+
+/**
+ * 搬送波を出しているはずか
+ *
+ * 搬送波を出すコマンドを送ってから、 #rfOff() か #reset() するまでtrue.
+ *
+ * @retval		true		出している
+ */
+bool NfcPcd::isRfOn()
+{
+	return s_bRfOn;
+}
+
+
+/**
+ * 同じ結果になるコマンドを送り直す回数
+ *
+ * #sendCmd() がACKやレスポンスを受け取れなかったとき、Diagnose, GetGeneralStatus, RFConfiguration,
+ * InListPassiveTargetなどの何度送っても同じ結果になるコマンドだけを送り直す.
+ * 送り直しは統計のRetryに数える.
+ *
+ * @param[in]	Count		回数(0:送り直さない。デフォルトは0なので、送り直す場合はこれで設定する)
+ */
+void NfcPcd::setRetryLimit(uint8_t Count)
+{
+	s_RetryLimit = Count;
+}
+
+
+/**
+ * 直前のコマンドのやり直しを記録
+ *
+ * レスポンスを見て同じコマンドを送り直す上位層が、送り直す前に呼ぶ.
+ */
+void NfcPcd::countRetry()
+{
+	if(s_pCurStat) {
+		s_pCurStat->Retry++;
+	}
+}
+
+
+/**
+ * 時間分布からパーセンタイル値を求める
+ *
+ * @param[in]	pHist		時間分布(要素数:#STAT_HIST_NUM)
+ * @param[in]	Percent		パーセンタイル(1～100)
+ * @return		Percent[%]が収まる区間の上限[usec](0:分布が空)
+ */
+uint32_t NfcPcd::statPercentile(const uint32_t* pHist, uint8_t Percent)
+{
+	uint64_t num = 0;
+	for(int i = 0; i < STAT_HIST_NUM; i++) {
+		num += pHist[i];
+	}
+	if(num == 0) {
+		return 0;
+	}
+
+	uint64_t sum = 0;
+	int i;
+	for(i = 0; i < STAT_HIST_NUM - 1; i++) {
+		sum += pHist[i];
+		if(sum * 100 >= num * Percent) {
+			break;
+		}
+	}
+	return (uint32_t)1 << (i + 1);
+}
+
+
+/**
+ * 統計をテキストで出力
+ *
+ * 時間は送信からレスポンス(ACKのみの列はACK)までで、p50/p99は分布の区間の上限.
+ * ログレベルに関係なく出力する.
+ *
+ * @param[in]	fp			出力先
+ * @param[in]	pName		見出し(リーダーの区別用。0なら省略)
+ */
+void NfcPcd::printStat(FILE* fp, const char* pName/*=0*/)
+{
+	std::fprintf(fp, "[NfcPcd stat] %s\n", (pName) ? pName : "");
+	std::fprintf(fp, "cmd    count  noack   nack errfrm resperr resync  retry | ack-avg | resp-avg   p50   p99     max [usec]\n");
+	for(uint8_t i = 0; i < s_StatNum; i++) {
+		const CmdStat& st = s_Stat[i];
+		uint32_t ok = 0;
+		for(int j = 0; j < STAT_HIST_NUM; j++) {
+			ok += st.RespHist[j];
+		}
+		uint32_t acked = st.Count - st.NoAck - st.Nack;
+		std::fprintf(fp, " %02x %8u %6u %6u %6u %7u %6u %6u | %7" PRIu64 " | %8" PRIu64 " %5u %5u %7u\n",
+				st.Code, st.Count, st.NoAck, st.Nack, st.ErrFrame, st.RespErr, st.Resync, st.Retry,
+				(acked) ? st.AckUsec / acked : 0,
+				(ok) ? st.RespUsec / ok : 0,
+				statPercentile(st.RespHist, 50), statPercentile(st.RespHist, 99),
+				st.RespMaxUsec);
+	}
+}
+
+
 /////////////////////////////////////////////////////////////////////////
 // RC-S620/Sとのやりとり
 /////////////////////////////////////////////////////////////////////////
@@ -1120,57 +1983,163 @@ bool NfcPcd::sendCmd(
 			uint8_t* pResponse, uint16_t* pResponseLen,
 			bool bRecv/*=true*/)
 {
-	//LOGD("CommandLen : %d", CommandLen);
+	return sendCmd(pCommand, CommandLen, 0, 0, pResponse, pResponseLen, bRecv);
+}
+
+
+/**
+ * パケット送受信(ヘッダ + データ)
+ *
+ * コマンドをヘッダ部(0xd4, コマンドコード, 引数)とデータ部に分けて渡す.
+ * フレームはコピーせず、フレームヘッダ・pHead・pData・フレームフッタを
+ * そのままデバイスに渡す.
+ * 何度送っても同じ結果になるコマンド(Diagnose, GetGeneralStatus, RFConfiguration, InListPassiveTargetなど)は、
+ * 失敗したら #setRetryLimit() の回数まで送り直す.
+ *
+ * @param[in]	pHead			送信するコマンドのヘッダ部(0xd4含む)
+ * @param[in]	HeadLen			pHeadの長さ
+ * @param[in]	pData			送信するコマンドのデータ部(DataLenが0なら未使用)
+ * @param[in]	DataLen			pDataの長さ
+ * @param[out]	pResponse		レスポンス(0xd5含む)
+ * @param[out]	pResponseLen	pResponseの長さ
+ *
+ * @retval		true			成功
+ * @retval		false			失敗
+ */
+bool NfcPcd::sendCmd(
+			const uint8_t* pHead, uint16_t HeadLen,
+			const uint8_t* pData, uint16_t DataLen,
+			uint8_t* pResponse, uint16_t* pResponseLen,
+			bool bRecv/*=true*/)
+{
+	bool ret = sendCmdOnce(pHead, HeadLen, pData, DataLen, pResponse, pResponseLen, bRecv);
+	if(ret || !bRecv || (HeadLen < 2) || !_idempotent(pHead[1])) {
+		return ret;
+	}
+
+	//同じ結果になるコマンドは、送り直す
+	for(uint8_t i = 0; !ret && (i < s_RetryLimit); i++) {
+		LOGD("sendCmd retry(%02x)\n", pHead[1]);
+		countRetry();
+		ret = sendCmdOnce(pHead, HeadLen, pData, DataLen, pResponse, pResponseLen, bRecv);
+	}
+	return ret;
+}
+
+
+/**
+ * パケット送受信(1回だけ)
+ *
+ * @param[in]	pHead			送信するコマンドのヘッダ部(0xd4含む)
+ * @param[in]	HeadLen			pHeadの長さ
+ * @param[in]	pData			送信するコマンドのデータ部(DataLenが0なら未使用)
+ * @param[in]	DataLen			pDataの長さ
+ * @param[out]	pResponse		レスポンス(0xd5含む)
+ * @param[out]	pResponseLen	pResponseの長さ
+ *
+ * @retval		true			成功
+ * @retval		false			失敗
+ */
+bool NfcPcd::sendCmdOnce(
+			const uint8_t* pHead, uint16_t HeadLen,
+			const uint8_t* pData, uint16_t DataLen,
+			uint8_t* pResponse, uint16_t* pResponseLen,
+			bool bRecv)
+{
+	//LOGD("CommandLen : %d", HeadLen + DataLen);
 	*pResponseLen = 0;
 
+	uint16_t CommandLen = HeadLen + DataLen;
 	if(CommandLen > DATA_MAX) {
 		LOGE("too large\n");
 		return false;
 	}
 
-	uint16_t send_len = 3;
-	uint8_t dcs = _calc_dcs(pCommand, CommandLen);
-
+	uint16_t head_len = 3;
 	if(CommandLen <= NORMAL_DATA_MAX) {
 		// Normalフレーム
-		s_SendBuf[send_len++] = CommandLen;						//[3]
-		s_SendBuf[send_len++] = (uint8_t)(0 - s_SendBuf[3]);	//[4]
-		if(pCommand != s_SendBuf + POS_NORMALFRM_DATA) {
-			memcpy(s_SendBuf + send_len, pCommand, CommandLen);
-		}
+		s_FrmHead[head_len++] = CommandLen;						//[3]
+		s_FrmHead[head_len++] = (uint8_t)(0 - s_FrmHead[3]);	//[4]
 	} else {
 		// Extendedフレーム
-		s_SendBuf[send_len++] = 0xff;							//[3]
-		s_SendBuf[send_len++] = 0xff;							//[4]
-		s_SendBuf[send_len++] = (uint8_t)(CommandLen >> 8);		//[5]
-		s_SendBuf[send_len++] = (uint8_t)CommandLen;			//[6]
-		s_SendBuf[send_len++] = (uint8_t)(0 - s_SendBuf[5] - s_SendBuf[6]);
-		if(pCommand != s_SendBuf + POS_EXTENDFRM_DATA) {
-			memcpy(s_SendBuf + send_len, pCommand, CommandLen);
-		}
+		s_FrmHead[head_len++] = 0xff;							//[3]
+		s_FrmHead[head_len++] = 0xff;							//[4]
+		s_FrmHead[head_len++] = (uint8_t)(CommandLen >> 8);		//[5]
+		s_FrmHead[head_len++] = (uint8_t)CommandLen;			//[6]
+		s_FrmHead[head_len++] = (uint8_t)(0 - s_FrmHead[5] - s_FrmHead[6]);
+	}
+	uint8_t sum = _calc_sum(pHead, HeadLen);
+	if(DataLen) {
+		sum = _calc_sum(pData, DataLen, sum);
+	}
+	s_FrmTail[0] = (uint8_t)(0 - sum);		//DCS
+	s_FrmTail[1] = 0x00;
+
+	s_pCurStat = _find_stat((HeadLen >= 2) ? pHead[1] : 0xff);
+	if(s_pCurStat) {
+		s_pCurStat->Count++;
+	}
+	if(HeadLen >= 2) {
+		_rf_on(pHead[1]);
+	}
+	uint64_t start = nowUsec();
+
+	DevAccess::Segment seg[4];
+	uint8_t seg_num = 0;
+	seg[seg_num].pData = s_FrmHead;
+	seg[seg_num++].Len = head_len;
+	if(HeadLen) {
+		seg[seg_num].pData = pHead;
+		seg[seg_num++].Len = HeadLen;
+	}
+	if(DataLen) {
+		seg[seg_num].pData = pData;
+		seg[seg_num++].Len = DataLen;
 	}
-	send_len += CommandLen;
-	s_SendBuf[send_len++] = dcs;
-	s_SendBuf[send_len++] = 0x00;
+	seg[seg_num].pData = s_FrmTail;
+	seg[seg_num++].Len = FRMTAIL_LEN;
+	uint16_t send_len = head_len + CommandLen + FRMTAIL_LEN;
 
 #ifdef ENABLE_FRAME_LOG
 	LOGD("------------\n");
-	for(int i=0; i<send_len; i++) {
-		LOGD("[W]%02x \n", s_SendBuf[i]);
+	for(int j=0; j<seg_num; j++) {
+		for(int i=0; i<seg[j].Len; i++) {
+			LOGD("[W]%02x \n", seg[j].pData[i]);
+		}
 	}
 	LOGD("------------\n");
 #endif
 
-	if(DevAccess::write(s_SendBuf, send_len) != send_len) {
+	NFCTRACE(TR_TX, pHead, HeadLen, pData, DataLen);
+	if(_port_writev(seg, seg_num) != send_len) {
 		LOGE("write error.\n");
+		NFCTRACE(TR_NOACK, 0, 0);
+		if(s_pCurStat) {
+			s_pCurStat->NoAck++;
+		}
 		return false;
 	}
 
 	//ACK受信
 	uint8_t res_buf[6];
-	uint16_t ret_len = DevAccess::read(res_buf, 6);
+	uint16_t ret_len = _port_read(res_buf, 6);
+	if((ret_len == 6) && !_is_ack(res_buf)) {
+		//前のレスポンスの残りや雑音を読み飛ばす
+		ret_len = _resync(res_buf, 6, _is_ack) ? 6 : 0;
+	}
 	if((ret_len != 6) || (memcmp(res_buf, ACK, sizeof(ACK)) != 0)) {
 		LOGE("sendCmd 0: ret=%d\n", ret_len);
+		if((ret_len == 6) && (memcmp(res_buf, NACK, sizeof(NACK)) == 0)) {
+			NFCTRACE(TR_NACK, 0, 0);
+			if(s_pCurStat) {
+				s_pCurStat->Nack++;
+			}
+		} else {
+			NFCTRACE(TR_NOACK, res_buf, ret_len);
+			if(s_pCurStat) {
+				s_pCurStat->NoAck++;
+			}
+		}
 #ifdef ENABLE_FRAME_LOG
 		LOGD("------------\n");
 		for(int i=0; i<ret_len; i++) {
@@ -1182,8 +2151,40 @@ bool NfcPcd::sendCmd(
 		return false;
 	}
 
+	NFCTRACE(TR_ACK, 0, 0);
+	uint64_t ack = nowUsec() - start;
+	if(s_pCurStat) {
+		s_pCurStat->AckUsec += ack;
+		_add_hist(s_pCurStat->AckHist, ack);
+	}
+	if(!bRecv) {
+		return true;
+	}
+
 	// レスポンス
-	return (bRecv) ? recvResp(pResponse, pResponseLen, pCommand[1]) : true;
+	bool ret = recvResp(pResponse, pResponseLen, pHead[1]);
+	if(ret) {
+		NFCTRACE(TR_RX, pResponse, *pResponseLen);
+		if(s_pCurStat) {
+			uint64_t resp = nowUsec() - start;
+			s_pCurStat->RespUsec += resp;
+			if(resp > s_pCurStat->RespMaxUsec) {
+				s_pCurStat->RespMaxUsec = (uint32_t)resp;
+			}
+			_add_hist(s_pCurStat->RespHist, resp);
+		}
+	} else if((*pResponseLen == 1) && (pResponse[0] == 0x7f)) {
+		NFCTRACE(TR_ERRFRAME, 0, 0);
+		if(s_pCurStat) {
+			s_pCurStat->ErrFrame++;
+		}
+	} else {
+		NFCTRACE(TR_RXERR, pResponse, (*pResponseLen <= DATA_MAX) ? *pResponseLen : 0);
+		if(s_pCurStat) {
+			s_pCurStat->RespErr++;
+		}
+	}
+	return ret;
 }
 
 
@@ -1200,22 +2201,25 @@ bool NfcPcd::sendCmd(
 bool NfcPcd::recvResp(uint8_t* pResponse, uint16_t* pResponseLen, uint8_t CmdCode/*=0xff*/)
 {
 	uint8_t res_buf[6];
-	uint16_t ret_len = DevAccess::read(res_buf, 5);
+	uint16_t ret_len = _port_read(res_buf, 5);
 	if(ret_len != 5) {
 		LOGE("recvResp 1: ret=%d\n", ret_len);
 		sendAck();
 		return false;
 	}
 
-	if ((res_buf[0] != 0x00) || (res_buf[1] != 0x00) || (res_buf[2] != 0xff)) {
+	if(!_is_frame_head(res_buf) && !_resync(res_buf, 5, _is_frame_head)) {
+		//Start Codeが見つからない : 実行中のコマンドを止める
 		LOGE("recvResp 2\n");
+		sendAck();
 		return false;
 	}
 	if((res_buf[3] == 0xff) && (res_buf[4] == 0xff)) {
 		// extend frame
-		ret_len = DevAccess::read(res_buf, 3);
+		ret_len = _port_read(res_buf, 3);
 		if((ret_len != 3) || (((res_buf[0] + res_buf[1] + res_buf[2]) & 0xff) != 0)) {
 			LOGE("recvResp 3: ret=%d\n", ret_len);
+			sendAck();
 			return false;
 		}
 		*pResponseLen = (((uint16_t)res_buf[0] << 8) | res_buf[1]);
@@ -1223,16 +2227,18 @@ bool NfcPcd::recvResp(uint8_t* pResponse, uint16_t* pResponseLen, uint8_t CmdCod
 		// normal frame
 		if(((res_buf[3] + res_buf[4]) & 0xff) != 0) {
 			LOGE("recvResp 4\n");
+			sendAck();
 			return false;
 		}
 		*pResponseLen = res_buf[3];
 	}
 	if(*pResponseLen > RWBUF_MAX) {
 		LOGE("recvResp 5  len:%d\n", *pResponseLen);
+		sendAck();
 		return false;
 	}
 
-	ret_len = DevAccess::read(pResponse, *pResponseLen);
+	ret_len = _port_read(pResponse, *pResponseLen);
 
 #ifdef ENABLE_FRAME_LOG
 	LOGD("------------\n");
@@ -1258,7 +2264,7 @@ bool NfcPcd::recvResp(uint8_t* pResponse, uint16_t* pResponseLen, uint8_t CmdCod
 	}
 
 	uint8_t dcs = _calc_dcs(pResponse, *pResponseLen);
-	ret_len = DevAccess::read(res_buf, 2);
+	ret_len = _port_read(res_buf, 2);
 	if((ret_len != 2) || (res_buf[0] != dcs) || (res_buf[1] != 0x00)) {
 		LOGE("recvResp 8\n");
 		sendAck();
@@ -1276,7 +2282,7 @@ void NfcPcd::sendAck()
 {
 	LOGD("%s\n", __PRETTY_FUNCTION__);
 
-	DevAccess::write(ACK, sizeof(ACK));
+	_port_write(ACK, sizeof(ACK));
 
 	// wait 1ms
 	msleep(1);
@@ -6,6 +6,7 @@
 #ifndef NFCPCD_H
 #define NFCPCD_H
 
+#include <cstdio>
 #include "HkNfcRw.h"
 
 
@@ -19,12 +20,15 @@
 class NfcPcd {
 public:
 	static const uint16_t DATA_MAX = 265;		///< データ部最大長
+	static const uint32_t DEFAULT_BAUD = 115200;	///< 起動時のUART通信速度[bps]
 
 	static const uint8_t NFCID2_LEN = 8;		///< NFCID2サイズ
 	static const uint8_t NFCID3_LEN = 10;		///< NFCID3サイズ
 
 	/// 最大UID長(NFC-Bでの値)
 	static const uint8_t MAX_NFCID_LEN = 12;
+	/// InListPassiveTargetで一度に取得できる最大ターゲット数
+	static const uint8_t MAX_TG = 2;
 
 
 	/// @enum	ActPass
@@ -80,11 +84,13 @@ public:
 	/// @{
 
 	/// オープン
-	static bool portOpen();
+	static bool portOpen(const char* pPath=0, uint32_t Baud=DEFAULT_BAUD);
 	/// オープン済みかどうか
 	static bool isOpened() { return m_bOpened; }
 	/// クローズ
 	static void portClose();
+	/// 現在のUART通信速度[bps]
+	static uint32_t baudRate() { return m_BaudRate; }
 	/// @}
 
 
@@ -93,8 +99,21 @@ public:
 	/// @ingroup gp_NfcPcd
 	/// @{
 
+	/// @struct	RfConfig
+	/// @brief	#init()で送るRFConfigurationの設定
+	struct RfConfig {
+		uint8_t		Timeout[3];			///< RF通信のT/O(Item 0x02)
+		uint8_t		Retry[3];			///< Target捕捉時のRF通信リトライ回数(Item 0x05)
+		uint8_t		Wait;				///< RF出力ONからTargetID取得コマンド送信までの追加ウェイト時間(Item 0x81)
+		uint8_t		DepTimeout[3];		///< DEPターゲットでのタイムアウト(Item 0x82)
+	};
+
 	/// デバイス初期化
-	static bool init();
+	static bool init(bool bWarm=false);
+	/// 初期化で送るRFConfigurationの設定
+	static void setRfConfig(const RfConfig& cfg);
+	/// 初期化で送るRFConfigurationの設定取得
+	static const RfConfig& rfConfig();
 	/// RF出力停止
 	static bool rfOff();
 	/// RFConfiguration
@@ -105,10 +124,16 @@ public:
 	static bool diagnose(
 			uint8_t cmd, const uint8_t* pCommand, uint8_t CommandLen,
 			uint8_t* pResponse, uint8_t* pResponseLen);
+	/// Diagnose(Attention Request Test)
+	static bool attentionRequest();
 	/// SetParameters
 	static bool setParameters(uint8_t val);
 	/// WriteRegister
 	static bool writeRegister(const uint8_t* pCommand, uint8_t CommandLen);
+	/// SetSerialBaudRate
+	static bool setSerialBaudRate(uint32_t Baud);
+	/// 使える一番速い通信速度に切り替える
+	static uint32_t negotiateBaudRate(uint32_t MaxBaud);
 	/// GetFirmware
 	static const int GF_IC = 0;				///< GetFirmware:IC
 	static const int GF_VER = 1;			///< GetFirmware:Ver
@@ -135,6 +160,11 @@ public:
 			uint16_t Timeout,
 			const uint8_t* pCommand, uint8_t CommandLen,
 			uint8_t* pResponse, uint8_t* pResponseLen);
+	/// CommunicateThruEX(複数のレスポンスを連結のまま返す)
+	static bool communicateThruExAll(
+			uint16_t Timeout,
+			const uint8_t* pCommand, uint8_t CommandLen,
+			uint8_t* pResponse, uint16_t* pResponseLen);
 	/// @}
 
 
@@ -154,7 +184,12 @@ public:
 	/// InListPassiveTarget
 	static bool inListPassiveTarget(
 			const uint8_t* pInitData, uint8_t InitLen,
-			uint8_t** ppTgData, uint8_t* pTgLen);
+			uint8_t** ppTgData, uint8_t* pTgLen,
+			uint8_t MaxTg=1);
+	/// 最後のInListPassiveTargetで取得したターゲット数
+	static uint8_t listedTargetNum();
+	/// 最後のInListPassiveTargetで取得したターゲットのデータ
+	static const uint8_t* listedTarget(uint8_t Index, uint8_t* pLen);
 	/// InDataExchange
 	static bool inDataExchange(
 			const uint8_t* pCommand, uint8_t CommandLen,
@@ -269,6 +304,78 @@ public:
 	 * 保持しているNFCIDのクリア
 	 */
 	static void clrNfcId() { m_NfcIdLen = 0; std::memset(m_NfcId, 0x00, MAX_NFCID_LEN); }
+
+	/**
+	 * InDataExchangeの相手のターゲット番号(Tg)取得.
+	 * InListPassiveTarget, InJumpForDEP/PSLによって1になる.
+	 *
+	 * @return	Tg
+	 */
+	static uint8_t targetNo() { return m_TargetNo; }
+
+	/**
+	 * InDataExchangeの相手のターゲット番号(Tg)設定.
+	 *
+	 * @param[in]	Tg		InListPassiveTargetで取得したTg
+	 */
+	static void setTargetNo(uint8_t Tg) { m_TargetNo = Tg; }
+	/// @}
+
+
+	/// @addtogroup gp_capture	Capture
+	/// @ingroup gp_NfcPcd
+	/// @{
+public:
+	/// キャプチャ開始
+	static bool startCapture(const char* pPath);
+	/// キャプチャ終了
+	static void stopCapture();
+	/// @}
+
+
+	/// @addtogroup gp_stat	Statistics
+	/// @ingroup gp_NfcPcd
+	/// @{
+public:
+	static const uint8_t STAT_MAX = 32;			///< 記録するコマンドコードの最大数
+	static const uint8_t STAT_HIST_NUM = 20;	///< 時間分布の区間数(区間iは[2^i, 2^(i+1))usec。最後は上限なし)
+
+	/// @struct	CmdStat
+	/// @brief	コマンドコードごとの統計(スレッドごと)
+	struct CmdStat {
+		uint8_t		Code;						///< コマンドコード(0xd4の次のbyte)
+		uint32_t	Count;						///< 送信回数
+		uint32_t	NoAck;						///< ACKが来なかった回数(NACK以外)
+		uint32_t	Nack;						///< NACKが来た回数
+		uint32_t	ErrFrame;					///< Error Frameが来た回数
+		uint32_t	RespErr;					///< それ以外のレスポンス異常回数(タイムアウト, LCS/DCS異常など)
+		uint32_t	Resync;						///< ACKやフレームの前のデータを読み飛ばして合わせ直した回数
+		uint32_t	Retry;						///< 上位層や #setRetryLimit() でやり直した回数
+		uint64_t	AckUsec;					///< 送信からACKまでの時間の合計[usec]
+		uint64_t	RespUsec;					///< 送信からレスポンスまでの時間の合計[usec]
+		uint32_t	RespMaxUsec;				///< 送信からレスポンスまでの時間の最大[usec]
+		uint32_t	AckHist[STAT_HIST_NUM];		///< 送信からACKまでの時間の分布
+		uint32_t	RespHist[STAT_HIST_NUM];	///< 送信からレスポンスまでの時間の分布
+	};
+
+	/// 統計取得(全コマンド)
+	static uint8_t getStat(const CmdStat** ppStat);
+	/// 統計取得(コマンド指定)
+	static const CmdStat* getStat(uint8_t Code);
+	/// 統計クリア
+	static void clearStat();
+	/// 搬送波を出していた時間[usec]
+	static uint64_t rfOnUsec();
+	/// 搬送波を出しているはずか
+	static bool isRfOn();
+	/// 直前のコマンドのやり直しを記録
+	static void countRetry();
+	/// 同じ結果になるコマンドを送り直す回数
+	static void setRetryLimit(uint8_t Count);
+	/// 統計をテキストで出力
+	static void printStat(FILE* fp, const char* pName=0);
+	/// 時間分布からパーセンタイル値[usec]を求める
+	static uint32_t statPercentile(const uint32_t* pHist, uint8_t Percent);
 	/// @}
 
 
@@ -282,6 +389,18 @@ private:
 			const uint8_t* pCommand, uint16_t CommandLen,
 			uint8_t* pResponse, uint16_t* pResponseLen,
 			bool bRecv=true);
+	/// パケット送受信(ヘッダ + データ)
+	static bool sendCmd(
+			const uint8_t* pHead, uint16_t HeadLen,
+			const uint8_t* pData, uint16_t DataLen,
+			uint8_t* pResponse, uint16_t* pResponseLen,
+			bool bRecv=true);
+	/// パケット送受信(1回だけ)
+	static bool sendCmdOnce(
+			const uint8_t* pHead, uint16_t HeadLen,
+			const uint8_t* pData, uint16_t DataLen,
+			uint8_t* pResponse, uint16_t* pResponseLen,
+			bool bRecv);
 	/// レスポンス受信
 	static bool recvResp(uint8_t* pResponse, uint16_t* pResponseLen, uint8_t CmdCode=0xff);
 	/// ACK送信
@@ -290,11 +409,13 @@ private:
 
 
 private:
-	static bool		m_bOpened;					///< オープンしているかどうか
-	static uint8_t	s_CommandBuf[DATA_MAX];		///< PCDへの送信バッファ
-	static uint8_t	s_ResponseBuf[DATA_MAX];	///< PCDからの受信バッファ
-	static uint8_t	m_NfcId[MAX_NFCID_LEN];		///< 取得したNFCID
-	static uint8_t	m_NfcIdLen;					///< 取得済みのNFCID長。0の場合は未取得。
+	static HKNFC_TLS bool		m_bOpened;					///< オープンしているかどうか
+	static HKNFC_TLS uint32_t	m_BaudRate;					///< 現在のUART通信速度[bps]
+	static HKNFC_TLS uint8_t	s_CommandBuf[DATA_MAX];		///< PCDへの送信バッファ
+	static HKNFC_TLS uint8_t	s_ResponseBuf[DATA_MAX];	///< PCDからの受信バッファ
+	static HKNFC_TLS uint8_t	m_NfcId[MAX_NFCID_LEN];		///< 取得したNFCID
+	static HKNFC_TLS uint8_t	m_NfcIdLen;					///< 取得済みのNFCID長。0の場合は未取得。
+	static HKNFC_TLS uint8_t	m_TargetNo;					///< InDataExchangeの相手のTg
 };
 
 #endif /* NFCPCD_H */
@@ -2,14 +2,34 @@
 #define DEVACCESS_H
 
 #include <stdint.h>
+#include "HkNfcTls.h"
 
 namespace DevAccess
 {
-	bool open();
+	/// writev()に渡す送信データの断片
+	struct Segment {
+		const uint8_t*	pData;		///< データ
+		uint16_t		Len;		///< pDataの長さ
+	};
+
+	/// 送信後の待ち方
+	enum WritePolicy {
+		WP_NONE,		///< 待たない(デフォルト)
+		WP_DRAIN,		///< tcdrain()で送信完了まで待つ
+		WP_FSYNC		///< fsync()する
+	};
+
+	bool open(const char* pPath=0);
 	void close();
 	
 	uint16_t write(const uint8_t* data, uint16_t len);
+	uint16_t writev(const Segment* seg, uint8_t num);
     uint16_t read(uint8_t* data, uint16_t len);
+
+	void setWritePolicy(WritePolicy policy);
+
+	bool checkBaudRate(uint32_t baud);
+	bool setBaudRate(uint32_t baud);
 }
 
 #endif // DEVACCESS_H
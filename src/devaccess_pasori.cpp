@@ -15,21 +15,21 @@ namespace {
 	const uint16_t PID = 0x02e1;
 	const unsigned int TIMEOUT = 65535 * 2;
 
-	libusb_context*			m_pContext;
-	libusb_device_handle*	m_pHandle;
+	HKNFC_TLS libusb_context*			m_pContext;
+	HKNFC_TLS libusb_device_handle*	m_pHandle;
 
-	uint8_t m_EndPntIn = 0xff;
-	uint8_t m_EndPntOut = 0xff;
+	HKNFC_TLS uint8_t m_EndPntIn = 0xff;
+	HKNFC_TLS uint8_t m_EndPntOut = 0xff;
 
-	int m_ReadSize;
-	uint8_t m_ReadBuf[256];
-	int m_ReadPtr;
+	HKNFC_TLS int m_ReadSize;
+	HKNFC_TLS uint8_t m_ReadBuf[256];
+	HKNFC_TLS int m_ReadPtr;
 
+	/**
+	 * 状態はすべて上のHKNFC_TLS変数に持ち、このクラス自体はメンバを持たない.
+	 * HKNFC_TLSで置けるよう、コンストラクタ/デストラクタは定義しない(閉じるのは #close() で).
+	 */
 	class librcs370 {
-	public:
-		librcs370();
-		virtual ~librcs370();
-
 	public:
 		bool open();
 		void close();
@@ -38,16 +38,6 @@ namespace {
 		uint8_t read(uint8_t *pData, uint8_t size);
 	};
 
-	librcs370::librcs370()
-	{
-	}
-
-	librcs370::~librcs370()
-	{
-		close();
-	}
-
-
 	bool librcs370::open()
 	{
 		//LOGD("%s\n", __PRETTY_FUNCTION__);
@@ -219,15 +209,18 @@ namespace {
 namespace DevAccess {
 
 
-librcs370		m_Rcs;
+HKNFC_TLS librcs370		m_Rcs;
 
 /**
  * ポートオープン
  *
+ * @param[in]	pPath	未使用(VID/PIDで探す)
+ *
  * @retval	true	オープン成功
  */
-bool open()
+bool open(const char* pPath/*=0*/)
 {
+	(void)pPath;
 	return m_Rcs.open();
 }
 
@@ -262,6 +255,67 @@ uint16_t write(const uint8_t* data, uint16_t len)
 	return m_Rcs.write(data, len);
 }
 
+/**
+ * ポート送信(複数データ)
+ *
+ * USBは1回のbulk転送で送る必要があるため、連結してから送信する.
+ *
+ * @param[in]	seg			送信データの断片
+ * @param[in]	num			segの数
+ * @return					送信したサイズ
+ */
+uint16_t writev(const Segment* seg, uint8_t num)
+{
+	uint8_t buf[sizeof(m_ReadBuf) + 32];
+	uint16_t len = 0;
+	for(uint8_t i = 0; i < num; i++) {
+		if(len + seg[i].Len > sizeof(buf)) {
+			LOGE("writev : too large\n");
+			return 0;
+		}
+		std::memcpy(buf + len, seg[i].pData, seg[i].Len);
+		len += seg[i].Len;
+	}
+
+	return write(buf, len);
+}
+
+/**
+ * 送信後の待ち方設定
+ *
+ * @param[in]	policy		送信後の待ち方
+ *
+ * @note		- USBのbulk転送は完了まで待つので、何もしない.
+ */
+void setWritePolicy(WritePolicy policy)
+{
+	(void)policy;
+}
+
+/**
+ * 通信速度を変更できるか
+ *
+ * @param[in]	baud		通信速度[bps]
+ * @retval	false	USBなので変更できない
+ */
+bool checkBaudRate(uint32_t baud)
+{
+	(void)baud;
+	return false;
+}
+
+/**
+ * 通信速度変更
+ *
+ * @param[in]	baud		通信速度[bps]
+ * @retval	false	USBなので変更できない
+ */
+bool setBaudRate(uint32_t baud)
+{
+	(void)baud;
+	return false;
+}
+
 /**
  * 受信
  *
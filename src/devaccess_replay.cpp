@@ -0,0 +1,359 @@
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+
+#include "devaccess.h"
+#include "devaccess_replay.h"
+#include "nfccapture.h"
+#include "nfclog.h"
+
+
+namespace {
+	/*
+	 * 設定(全スレッド共通)
+	 */
+	bool s_bTiming = false;					///< キャプチャ時の間隔で返すかどうか
+
+	/*
+	 * 再生の状態(スレッドごと)
+	 */
+	HKNFC_TLS uint8_t* s_pBuf = 0;			///< キャプチャファイルの中身(0:オープンしていない)
+	HKNFC_TLS uint32_t s_BufLen = 0;		///< s_pBufの長さ
+	HKNFC_TLS uint32_t s_Pos = 0;			///< 今のレコードの位置
+	HKNFC_TLS uint16_t s_RecPos = 0;		///< 今のレコードのデータの読み出し位置
+	HKNFC_TLS uint32_t s_RecNo = 0;			///< 今のレコードの番号(0から)
+	HKNFC_TLS uint32_t s_Mismatch = 0;		///< 送信データがキャプチャと違っていた回数
+
+
+/**
+ * 今のレコードがあるかどうか
+ */
+inline bool hasRecord()
+{
+	return s_Pos < s_BufLen;
+}
+
+/**
+ * 今のレコードの向き
+ */
+inline uint8_t recDir()
+{
+	return s_pBuf[s_Pos];
+}
+
+/**
+ * 今のレコードのデータ長
+ */
+inline uint16_t recLen()
+{
+	return uint16_t(s_pBuf[s_Pos + 1] | (s_pBuf[s_Pos + 2] << 8));
+}
+
+/**
+ * 今のレコードの前のレコードからの経過時間[usec]
+ */
+inline uint32_t recDelta()
+{
+	const uint8_t* p = s_pBuf + s_Pos + 3;
+	return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+/**
+ * 今のレコードのデータ
+ */
+inline const uint8_t* recData()
+{
+	return s_pBuf + s_Pos + NfcCapture::RECHEAD_LEN;
+}
+
+/**
+ * 次のレコードへ進む
+ */
+void nextRecord()
+{
+	s_Pos += NfcCapture::RECHEAD_LEN + recLen();
+	s_RecPos = 0;
+	s_RecNo++;
+}
+
+/**
+ * レコードを最後までたどって、途中で切れていれば切り捨てる
+ *
+ * @return		レコード数
+ */
+uint32_t checkRecords()
+{
+	uint32_t num = 0;
+	uint32_t pos = NfcCapture::FILEHEAD_LEN;
+	while(pos + NfcCapture::RECHEAD_LEN <= s_BufLen) {
+		uint32_t next = pos + NfcCapture::RECHEAD_LEN + uint16_t(s_pBuf[pos + 1] | (s_pBuf[pos + 2] << 8));
+		if((s_pBuf[pos] > NfcCapture::DIR_RX) || (next > s_BufLen)) {
+			break;
+		}
+		pos = next;
+		num++;
+	}
+	if(pos != s_BufLen) {
+		LOGE("replay : broken record at %u\n", num);
+		s_BufLen = pos;
+	}
+	return num;
+}
+
+}	//namespace
+
+
+/**
+ * @brief		キャプチャ再生の設定と結果
+ */
+namespace DevReplay {
+
+/**
+ * RXレコードをキャプチャ時の間隔で返すかどうか
+ *
+ * @param[in]	bEnable		true:RXレコードの経過時間だけ待ってから返す / false:待たない(デフォルト)
+ */
+void setTiming(bool bEnable)
+{
+	s_bTiming = bEnable;
+}
+
+
+/**
+ * 送信データがキャプチャと違っていた回数
+ *
+ * @return		回数(DevAccess::open()で0に戻る)
+ */
+uint32_t mismatch()
+{
+	return s_Mismatch;
+}
+
+
+/**
+ * キャプチャを最後まで使ったかどうか
+ *
+ * @retval		true		最後まで使った(オープンしていないときもtrue)
+ */
+bool isEnd()
+{
+	return !s_pBuf || !hasRecord();
+}
+
+}	//namespace DevReplay
+
+
+/**
+ * @brief		キャプチャ再生用のI/F
+ */
+namespace DevAccess {
+
+/**
+ * ポートオープン
+ *
+ * キャプチャファイルを全部メモリに読み込む.
+ *
+ * @param[in]	pPath	キャプチャファイルのパス
+ *
+ * @retval	true	オープン成功
+ * @retval	false	オープン失敗(ファイルがない, 形式が違う)
+ */
+bool open(const char* pPath/*=0*/)
+{
+	if(s_pBuf) {
+		LOGE("already opened\n");
+		return false;
+	}
+	if(!pPath) {
+		LOGE("replay : no capture file\n");
+		return false;
+	}
+
+	FILE* fp = fopen(pPath, "rb");
+	if(!fp) {
+		LOGE("replay : cannot open %s\n", pPath);
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if(size < NfcCapture::FILEHEAD_LEN) {
+		LOGE("replay : too short\n");
+		fclose(fp);
+		return false;
+	}
+	s_pBuf = new uint8_t[size];
+	s_BufLen = (uint32_t)fread(s_pBuf, 1, size, fp);
+	fclose(fp);
+
+	if((s_BufLen < NfcCapture::FILEHEAD_LEN)
+	  || (std::memcmp(s_pBuf, NfcCapture::MAGIC, sizeof(NfcCapture::MAGIC)) != 0)
+	  || (uint16_t(s_pBuf[4] | (s_pBuf[5] << 8)) != NfcCapture::VERSION)) {
+		LOGE("replay : bad header\n");
+		close();
+		return false;
+	}
+
+	uint32_t num = checkRecords();
+	LOGD("replay : %u records\n", num);
+	(void)num;
+
+	s_Pos = NfcCapture::FILEHEAD_LEN;
+	s_RecPos = 0;
+	s_RecNo = 0;
+	s_Mismatch = 0;
+	return true;
+}
+
+
+/**
+ * ポートクローズ
+ */
+void close()
+{
+	delete[] s_pBuf;
+	s_pBuf = 0;
+	s_BufLen = 0;
+}
+
+
+/**
+ * ポート送信
+ *
+ * @param[in]	data		送信データ
+ * @param[in]	len			dataの長さ
+ * @return					送信したサイズ
+ */
+uint16_t write(const uint8_t* data, uint16_t len)
+{
+	Segment seg;
+	seg.pData = data;
+	seg.Len = len;
+	return writev(&seg, 1);
+}
+
+/**
+ * ポート送信(複数データ)
+ *
+ * 読まれなかったRXレコードを捨ててから、次のTXレコードと突き合わせる.
+ * 違っていても、キャプチャどおりに進める.
+ *
+ * @param[in]	seg			送信データの断片
+ * @param[in]	num			segの数
+ * @return					送信したサイズ
+ */
+uint16_t writev(const Segment* seg, uint8_t num)
+{
+	if(!s_pBuf) {
+		return 0;
+	}
+
+	while(hasRecord() && (recDir() == NfcCapture::DIR_RX)) {
+		nextRecord();
+	}
+
+	uint16_t len = 0;
+	for(uint8_t i = 0; i < num; i++) {
+		len += seg[i].Len;
+	}
+	if(!hasRecord()) {
+		LOGE("replay : no more tx record\n");
+		s_Mismatch++;
+		return len;
+	}
+
+	bool match = (len == recLen());
+	uint16_t pos = 0;
+	for(uint8_t i = 0; match && (i < num); i++) {
+		match = (std::memcmp(recData() + pos, seg[i].pData, seg[i].Len) == 0);
+		pos += seg[i].Len;
+	}
+	if(!match) {
+		LOGE("replay : tx mismatch at record %u\n", s_RecNo);
+		s_Mismatch++;
+	}
+	nextRecord();
+
+	return len;
+}
+
+/**
+ * 送信後の待ち方設定
+ *
+ * @param[in]	policy		送信後の待ち方
+ *
+ * @note		- 何もしない.
+ */
+void setWritePolicy(WritePolicy policy)
+{
+	(void)policy;
+}
+
+/**
+ * 通信速度を変更できるか
+ *
+ * @param[in]	baud		通信速度[bps]
+ * @retval	true	変更できる
+ */
+bool checkBaudRate(uint32_t baud)
+{
+	(void)baud;
+	return true;
+}
+
+/**
+ * 通信速度変更
+ *
+ * @param[in]	baud		通信速度[bps]
+ * @retval	true	成功
+ *
+ * @note		- 何もしない(変更のコマンドはキャプチャで突き合わせる).
+ */
+bool setBaudRate(uint32_t baud)
+{
+	(void)baud;
+	return true;
+}
+
+/**
+ * 受信
+ *
+ * 続いているRXレコードから返す.
+ *
+ * @param[out]	data		受信バッファ
+ * @param[in]	len			受信サイズ
+ *
+ * @return					受信したサイズ
+ *
+ * @note		- 次がTXレコードかキャプチャの終わりなら、そこまでで戻る(実機ではタイムアウトになる).
+ */
+uint16_t read(uint8_t* data, uint16_t len)
+{
+	if(!s_pBuf) {
+		return 0;
+	}
+
+	uint16_t ret_len = 0;
+	while((ret_len < len) && hasRecord() && (recDir() == NfcCapture::DIR_RX)) {
+		if(s_bTiming && (s_RecPos == 0)) {
+			usleep(recDelta());
+		}
+		uint16_t n = recLen() - s_RecPos;
+		if(n > len - ret_len) {
+			n = len - ret_len;
+		}
+		std::memcpy(data + ret_len, recData() + s_RecPos, n);
+		ret_len += n;
+		s_RecPos += n;
+		if(s_RecPos == recLen()) {
+			nextRecord();
+		}
+	}
+	if(ret_len != len) {
+		LOGE("read err: ret_len=%d\n", ret_len);
+	}
+
+	return ret_len;
+}
+
+}	//namespace DevAccess
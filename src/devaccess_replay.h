@@ -0,0 +1,24 @@
+#ifndef DEVACCESS_REPLAY_H
+#define DEVACCESS_REPLAY_H
+
+#include <stdint.h>
+
+/**
+ * @brief	キャプチャ再生(devaccess_replay.cpp)の設定と結果
+ *
+ * devaccess_replay.cppはDevAccessの実装で、NfcPcd::startCapture()で取ったファイルを
+ * PCDの代わりに返す. DevAccess::open()にはキャプチャファイルのパスを渡す.
+ *
+ * 送信データはキャプチャのTXレコードと突き合わせ、違っていれば数える(#mismatch()).
+ * 受信はキャプチャのRXレコードをそのまま返す. 次がTXレコードなら、それ以上は返さない.
+ */
+namespace DevReplay {
+	/// RXレコードをキャプチャ時の間隔で返すかどうか(全スレッド共通)
+	void setTiming(bool bEnable);
+	/// 送信データがキャプチャと違っていた回数
+	uint32_t mismatch();
+	/// キャプチャを最後まで使ったかどうか
+	bool isEnd();
+}
+
+#endif /* DEVACCESS_REPLAY_H */
@@ -0,0 +1,1131 @@
+#include <cstring>
+#include <unistd.h>
+
+#include "devaccess.h"
+#include "devaccess_sim.h"
+#include "nfclog.h"
+
+// デバッグ設定
+//#define DBG_WRITEDATA
+//#define DBG_READDATA
+
+
+namespace {
+	const uint16_t FRAME_MAX = 265 + 10;		///< フレームの最大長
+	const uint16_t BUF_SIZE = FRAME_MAX * 2;	///< 送受信バッファサイズ
+	const uint8_t ACK[] = { 0x00, 0x00, 0xff, 0x00, 0xff, 0x00 };
+	const uint8_t ERRFRAME[] = { 0x00, 0x00, 0xff, 0x01, 0xff, 0x7f, 0x81, 0x00 };
+	const uint16_t BLOCK_SIZE = 16;
+	const uint8_t CARD_MAX = 4;					///< 同時にかざせるカードの最大数
+
+	/// CommunicateThruEx / InDataExchangeの「応答なし」
+	const uint8_t STATUS_TIMEOUT = 0x01;
+
+	/*
+	 * 設定(全スレッド共通)
+	 */
+
+	/// 標準のカード(FeliCa)のメモリ
+	uint8_t s_DefaultMemory[BLOCK_SIZE * 256];
+
+	/// 標準のカード(FeliCa)
+	const DevSim::Card DEFAULT_CARD = {
+		HkNfcRw::NFC_F,
+		{ 0x01, 0x2e, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 }, 8,
+		{ 0x03, 0x01, 0x4b, 0x02, 0x4f, 0x49, 0x93, 0xff },
+		0x12fc,
+		15, 12,
+		s_DefaultMemory, 256,
+		false,
+		0x00
+	};
+
+	DevSim::Card s_Cards[CARD_MAX] = { DEFAULT_CARD };	///< かざしているカード
+	uint8_t s_CardNum = 1;					///< s_Cardsの枚数
+	uint32_t s_CardGen = 0;					///< カードを置き換えるたびに進める
+	uint32_t s_RfLatency = 0;				///< RF通信の時間[usec]
+	bool s_bWireDelay = false;				///< 転送時間を待つかどうか
+	bool s_bDepTarget = false;				///< NFC-DEPのTargetがいるかどうか
+	DevSim::Fault s_Fault = DevSim::FAULT_NONE;	///< 起こす異常
+	uint16_t s_FaultCount = 0;				///< 異常を起こす残り回数
+
+	/*
+	 * 擬似PCDの状態(スレッドごと)
+	 */
+	HKNFC_TLS bool s_bOpened = false;			///< オープンしているかどうか
+	HKNFC_TLS DevSim::Card* s_pCard = 0;		///< コマンドの相手のカード(0:いない)
+	HKNFC_TLS uint8_t s_TgCard[CARD_MAX];		///< InListPassiveTargetで返したTgのカード番号(Tg-1の順)
+	HKNFC_TLS uint8_t s_TgNum = 0;				///< s_TgCardの数
+	HKNFC_TLS uint32_t s_TgGen = 0;				///< s_TgCardを作ったときのs_CardGen
+	HKNFC_TLS uint32_t s_Baud = 115200;			///< 通信速度[bps]
+	HKNFC_TLS uint8_t s_TxBuf[BUF_SIZE];		///< ホストからのデータ
+	HKNFC_TLS uint16_t s_TxLen = 0;				///< s_TxBufの長さ
+	HKNFC_TLS uint8_t s_RxBuf[BUF_SIZE];		///< ホストへのデータ
+	HKNFC_TLS uint16_t s_RxLen = 0;				///< s_RxBufの長さ
+	HKNFC_TLS uint16_t s_RxPos = 0;				///< s_RxBufの読み出し位置
+	HKNFC_TLS uint16_t s_RespPos = 0;			///< s_RxBufのレスポンスの開始位置
+	HKNFC_TLS uint32_t s_RespDelay = 0;			///< レスポンスまでの待ち[usec]
+	HKNFC_TLS bool s_bDep = false;				///< NFC-DEP中かどうか
+	HKNFC_TLS bool s_bLlcp = false;				///< LLCPのGeneralBytesを交換したかどうか
+	HKNFC_TLS uint8_t s_LlcpDsap = 0;			///< Target側から見たDSAP
+	HKNFC_TLS uint8_t s_LlcpSsap = 0;			///< Target側から見たSSAP
+	HKNFC_TLS uint8_t s_LlcpVS = 0;				///< Target側のV(S)
+	HKNFC_TLS uint8_t s_LlcpVR = 0;				///< Target側のV(R)
+
+
+/**
+ * ホストへ送るデータを積む
+ */
+void rxPush(const uint8_t* data, uint16_t len)
+{
+	if(s_RxLen + len > BUF_SIZE) {
+		LOGE("sim : rx overflow\n");
+		return;
+	}
+	std::memcpy(s_RxBuf + s_RxLen, data, len);
+	s_RxLen += len;
+}
+
+/**
+ * レスポンスフレームを積む
+ *
+ * @param[in]	pResp		レスポンス(0xd5含む)
+ * @param[in]	len			pRespの長さ
+ * @param[in]	bBadDcs		DCSを壊す
+ */
+void rxPushFrame(const uint8_t* pResp, uint16_t len, bool bBadDcs)
+{
+	uint8_t head[8] = { 0x00, 0x00, 0xff };
+	uint16_t head_len = 3;
+	if(len <= 255) {
+		head[head_len++] = uint8_t(len);
+		head[head_len++] = uint8_t(0 - len);
+	} else {
+		head[head_len++] = 0xff;
+		head[head_len++] = 0xff;
+		head[head_len++] = uint8_t(len >> 8);
+		head[head_len++] = uint8_t(len);
+		head[head_len++] = uint8_t(0 - head[5] - head[6]);
+	}
+	uint8_t sum = 0;
+	for(uint16_t i = 0; i < len; i++) {
+		sum += pResp[i];
+	}
+	uint8_t tail[2];
+	tail[0] = uint8_t(0 - sum);
+	if(bBadDcs) {
+		tail[0] ^= 0xff;
+	}
+	tail[1] = 0x00;
+
+	rxPush(head, head_len);
+	rxPush(pResp, len);
+	rxPush(tail, sizeof(tail));
+}
+
+/**
+ * RF通信を伴うコマンドかどうか
+ */
+bool isRfCommand(uint8_t cmd)
+{
+	switch(cmd) {
+	case 0x40:		//InDataExchange
+	case 0x42:		//InCommunicateThru
+	case 0x46:		//InJumpForPSL
+	case 0x4a:		//InListPassiveTarget
+	case 0x56:		//InJumpForDEP
+	case 0xa0:		//CommunicateThruEx
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * 異常を1回分取り出す
+ */
+DevSim::Fault takeFault()
+{
+	if(s_FaultCount == 0) {
+		return DevSim::FAULT_NONE;
+	}
+	s_FaultCount--;
+	return s_Fault;
+}
+
+/**
+ * 指定したタイプのカードを探す
+ *
+ * @param[in]	type		NFCタイプ
+ * @param[in]	pNfcId		NFCID(0:最初に見つかったカード)
+ * @return		カード(0:いない)
+ */
+DevSim::Card* findCard(HkNfcRw::Type type, const uint8_t* pNfcId)
+{
+	for(uint8_t i = 0; i < s_CardNum; i++) {
+		DevSim::Card* p = &s_Cards[i];
+		if((p->Type == type) && (!pNfcId || (std::memcmp(p->NfcId, pNfcId, p->NfcIdLen) == 0))) {
+			return p;
+		}
+	}
+	return 0;
+}
+
+/**
+ * InListPassiveTargetで返したTgのカード
+ *
+ * @param[in]	tg			Tg
+ * @return		カード(0:いない)
+ */
+DevSim::Card* tgCard(uint8_t tg)
+{
+	if((tg == 0) || (tg > s_TgNum) || (s_TgGen != s_CardGen)) {
+		//カードが置き換わっていれば、活性化したターゲットはもういない
+		return 0;
+	}
+	return &s_Cards[s_TgCard[tg - 1]];
+}
+
+/**
+ * システムコードの比較(0xffはワイルドカード)
+ */
+bool matchSystemCode(uint8_t h, uint8_t l)
+{
+	return ((h == 0xff) || (h == uint8_t(s_pCard->SystemCode >> 8)))
+		&& ((l == 0xff) || (l == uint8_t(s_pCard->SystemCode)));
+}
+
+/**
+ * ブロックリストからメモリの位置を取り出す
+ *
+ * @param[in,out]	ppElem		ブロックリストエレメント(次に進める)
+ * @param[in]		pEnd		ブロックリストの終わり
+ * @return			メモリ(0:範囲外)
+ */
+uint8_t* blockMemory(const uint8_t** ppElem, const uint8_t* pEnd)
+{
+	const uint8_t* p = *ppElem;
+	uint16_t blk;
+	if(p[0] & 0x80) {
+		//2byte
+		if(p + 2 > pEnd) {
+			return 0;
+		}
+		blk = p[1];
+		*ppElem = p + 2;
+	} else {
+		//3byte
+		if(p + 3 > pEnd) {
+			return 0;
+		}
+		blk = uint16_t(p[1] | (p[2] << 8));
+		*ppElem = p + 3;
+	}
+	if(blk >= s_pCard->BlockNum) {
+		return 0;
+	}
+	return s_pCard->pMemory + blk * BLOCK_SIZE;
+}
+
+/**
+ * FeliCaコマンド
+ *
+ * @param[in]	f			コマンド(LEN含む)
+ * @param[in]	len			fの長さ
+ * @param[out]	r			レスポンス(LEN含む)
+ * @return		rの長さ(0:応答なし)
+ */
+uint16_t felicaCommand(const uint8_t* f, uint16_t len, uint8_t* r)
+{
+	if((len < 2) || (f[0] != len)) {
+		return 0;
+	}
+
+	uint16_t pos = 1;
+	r[pos++] = uint8_t(f[1] + 1);
+	if(f[1] == 0x00) {
+		//Polling : s_pCardが応答する
+		if(!s_pCard || (s_pCard->Type != HkNfcRw::NFC_F)
+		  || (len < 5) || !matchSystemCode(f[2], f[3])) {
+			return 0;
+		}
+		std::memcpy(r + pos, s_pCard->NfcId, 8);
+		pos += 8;
+		std::memcpy(r + pos, s_pCard->PMm, 8);
+		pos += 8;
+		if(f[4] == 0x01) {
+			r[pos++] = uint8_t(s_pCard->SystemCode >> 8);
+			r[pos++] = uint8_t(s_pCard->SystemCode);
+		}
+		r[0] = uint8_t(pos);
+		return pos;
+	}
+
+	//以下はIDm指定
+	s_pCard = (len >= 10) ? findCard(HkNfcRw::NFC_F, f + 2) : 0;
+	if(!s_pCard) {
+		return 0;
+	}
+	std::memcpy(r + pos, s_pCard->NfcId, 8);
+	pos += 8;
+
+	switch(f[1]) {
+	case 0x04:		//Request Response
+		r[pos++] = 0x00;			//Mode0
+		break;
+
+	case 0x06:		//Read Without Encryption
+	case 0x08:		//Write Without Encryption
+	{
+		bool bWrite = (f[1] == 0x08);
+		const uint8_t* p = f + 10;
+		const uint8_t* end = f + len;
+		uint8_t sf2 = 0x00;
+		uint8_t svc_num = (p < end) ? *p++ : 0;
+		if((svc_num == 0) || (svc_num > 16)) {
+			sf2 = 0xa1;
+		}
+		p += svc_num * 2;
+		uint8_t blk_num = (p < end) ? *p++ : 0;
+		uint8_t blk_max = (bWrite) ? s_pCard->WriteBlockMax : s_pCard->ReadBlockMax;
+		if(!sf2 && ((blk_num == 0) || (blk_num > blk_max) || (blk_num > 16))) {
+			sf2 = 0xa2;
+		}
+
+		uint8_t* mem[16];
+		for(uint8_t i = 0; !sf2 && (i < blk_num); i++) {
+			mem[i] = blockMemory(&p, end);
+			if(mem[i] == 0) {
+				sf2 = 0xa8;
+			}
+		}
+		if(!sf2 && bWrite && (p + blk_num * BLOCK_SIZE != end)) {
+			sf2 = 0xa2;
+		}
+		if(sf2) {
+			r[pos++] = 0xff;
+			r[pos++] = sf2;
+		} else {
+			r[pos++] = 0x00;
+			r[pos++] = 0x00;
+			if(bWrite) {
+				for(uint8_t i = 0; i < blk_num; i++) {
+					std::memcpy(mem[i], p + i * BLOCK_SIZE, BLOCK_SIZE);
+				}
+			} else {
+				r[pos++] = blk_num;
+				for(uint8_t i = 0; i < blk_num; i++) {
+					std::memcpy(r + pos, mem[i], BLOCK_SIZE);
+					pos += BLOCK_SIZE;
+				}
+			}
+		}
+		break;
+	}
+
+	case 0x0c:		//Request System Code
+		r[pos++] = 0x01;
+		r[pos++] = uint8_t(s_pCard->SystemCode >> 8);
+		r[pos++] = uint8_t(s_pCard->SystemCode);
+		break;
+
+	default:
+		return 0;
+	}
+
+	r[0] = uint8_t(pos);
+	return pos;
+}
+
+/**
+ * FeliCaのPolling(タイムスロット指定)
+ *
+ * カードはIDmの最後のバイトで決まるスロットで応答し、同じスロットのカードは衝突して届かない.
+ * レスポンスはスロット順に連結する.
+ *
+ * @param[in]	f			コマンド(LEN含む)
+ * @param[in]	len			fの長さ
+ * @param[out]	r			レスポンス(LEN含む)
+ * @return		rの長さ(0:応答なし)
+ */
+uint16_t felicaPollingSlots(const uint8_t* f, uint16_t len, uint8_t* r)
+{
+	uint8_t slots = uint8_t(f[5] + 1);
+	uint16_t pos = 0;
+	for(uint8_t slot = 0; slot < slots; slot++) {
+		DevSim::Card* pHit = 0;
+		uint8_t hit = 0;
+		for(uint8_t i = 0; i < s_CardNum; i++) {
+			s_pCard = &s_Cards[i];
+			if((s_pCard->Type == HkNfcRw::NFC_F) && (s_pCard->NfcId[7] % slots == slot)
+			  && matchSystemCode(f[2], f[3])) {
+				pHit = s_pCard;
+				hit++;
+			}
+		}
+		if(hit == 1) {
+			s_pCard = pHit;
+			pos += felicaCommand(f, len, r + pos);
+		}
+	}
+	return pos;
+}
+
+/**
+ * NFC-A(Type2)コマンド
+ *
+ * @param[in]	c			コマンド
+ * @param[in]	len			cの長さ
+ * @param[out]	r			レスポンス
+ * @return		rの長さ(0:応答なし)
+ */
+uint16_t typeACommand(const uint8_t* c, uint16_t len, uint8_t* r)
+{
+	if(!s_pCard || (s_pCard->Type != HkNfcRw::NFC_A) || (len < 2)) {
+		return 0;
+	}
+
+	uint16_t addr = uint16_t(c[1] * 4);
+	uint16_t size = s_pCard->BlockNum * BLOCK_SIZE;
+	switch(c[0]) {
+	case 0x30:		//READ
+		for(uint16_t i = 0; i < BLOCK_SIZE; i++) {
+			r[i] = s_pCard->pMemory[(addr + i) % size];
+		}
+		return BLOCK_SIZE;
+
+	case 0xa2:		//WRITE
+		if((len < 6) || (addr + 4 > size)) {
+			return 0;
+		}
+		std::memcpy(s_pCard->pMemory + addr, c + 2, 4);
+		r[0] = 0x0a;
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+/**
+ * InListPassiveTarget
+ *
+ * BrTyに合うカードを、かざした順にMaxTg枚まで返す.
+ *
+ * @param[in]	c			コマンド(0xd4含む)
+ * @param[in]	len			cの長さ
+ * @param[out]	r			レスポンス(0xd5含む)
+ * @return		rの長さ
+ */
+uint16_t inListPassiveTarget(const uint8_t* c, uint16_t len, uint8_t* r)
+{
+	uint16_t pos = 2;
+	r[pos++] = 0x00;		//NbTg
+	s_TgNum = 0;
+	if(len < 4) {
+		return pos;
+	}
+
+	uint8_t max_tg = c[2];
+	uint8_t brty = c[3];
+	s_TgGen = s_CardGen;
+	for(uint8_t i = 0; (i < s_CardNum) && (s_TgNum < max_tg); i++) {
+		s_pCard = &s_Cards[i];
+		uint16_t tg_pos = pos;
+		r[pos++] = uint8_t(s_TgNum + 1);	//Tg
+		if(((brty == 0x01) || ((brty == 0x02) && !s_pCard->bOnly212K)) && (s_pCard->Type == HkNfcRw::NFC_F)) {
+			uint8_t f[6];
+			f[0] = 6;
+			std::memcpy(f + 1, c + 4, (len - 4 < 5) ? len - 4 : 5);
+			uint8_t res[32];
+			uint16_t res_len = (len >= 9) ? felicaCommand(f, sizeof(f), res) : 0;
+			std::memcpy(r + pos, res, res_len);
+			pos += res_len;
+		} else if((brty == 0x00) && (s_pCard->Type == HkNfcRw::NFC_A)) {
+			r[pos++] = 0x00;	//SENS_RES
+			r[pos++] = 0x44;
+			r[pos++] = s_pCard->SelRes;	//SEL_RES
+			r[pos++] = s_pCard->NfcIdLen;
+			std::memcpy(r + pos, s_pCard->NfcId, s_pCard->NfcIdLen);
+			pos += s_pCard->NfcIdLen;
+		} else if((brty == 0x03) && (s_pCard->Type == HkNfcRw::NFC_B)) {
+			r[pos++] = 0x50;	//ATQB
+			std::memcpy(r + pos, s_pCard->NfcId, 4);
+			pos += 4;
+			std::memset(r + pos, 0x00, 4);		//Application Data
+			pos += 4;
+			r[pos++] = 0x00;	//Protocol Info
+			r[pos++] = 0x81;
+			r[pos++] = 0x71;
+			r[pos++] = 0x01;	//ATTRIB_RES長
+			r[pos++] = 0x00;
+		}
+		if(pos == tg_pos + 1) {
+			//応答なし
+			pos = tg_pos;
+			continue;
+		}
+		s_TgCard[s_TgNum++] = i;
+	}
+	r[2] = s_TgNum;
+	s_pCard = tgCard(1);
+
+	return pos;
+}
+
+/**
+ * InJumpForDEP
+ *
+ * NFCID3とLLCPのGeneralBytesは固定.
+ * InitiatorがGeneralBytesを付けたときだけ、LLCPのGeneralBytesを返す.
+ *
+ * @param[in]	c			コマンド(0xd4含む)
+ * @param[in]	len			cの長さ
+ * @param[out]	r			レスポンス(0xd5含む)
+ * @return		rの長さ
+ */
+uint16_t inJumpForDep(const uint8_t* c, uint16_t len, uint8_t* r)
+{
+	const uint8_t NFCID3[] = { 0x01, 0xfe, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11 };
+	const uint8_t LLCP_GB[] = {
+		0x46, 0x66, 0x6d,			//Magic Number
+		0x01, 0x01, 0x10,			//VERSION
+		0x03, 0x02, 0x00, 0x13,		//WKS
+		0x04, 0x01, 0x64,			//LTO
+		0x07, 0x01, 0x03			//OPT
+	};
+
+	uint16_t pos = 2;
+	if(!s_bDepTarget || (len < 5)) {
+		r[pos++] = STATUS_TIMEOUT;
+		return pos;
+	}
+
+	s_bLlcp = (c[4] & 0x04) != 0;
+	r[pos++] = 0x00;		//Status
+	r[pos++] = 0x01;		//Tg
+	std::memcpy(r + pos, NFCID3, sizeof(NFCID3));
+	pos += sizeof(NFCID3);
+	r[pos++] = 0x00;		//DIDt
+	r[pos++] = 0x00;		//BSt
+	r[pos++] = 0x00;		//BRt
+	r[pos++] = 0x0e;		//TO
+	if(s_bLlcp) {
+		r[pos++] = 0x32;	//PPt(Gtあり)
+		std::memcpy(r + pos, LLCP_GB, sizeof(LLCP_GB));
+		pos += sizeof(LLCP_GB);
+	} else {
+		r[pos++] = 0x30;	//PPt
+	}
+	s_bDep = true;
+	s_LlcpDsap = 0;
+	s_LlcpSsap = 0;
+
+	return pos;
+}
+
+/**
+ * LLCP PDU作成
+ *
+ * @param[out]	r			PDU
+ * @param[in]	type		PDU種別
+ * @param[in]	dsap		DSAP
+ * @param[in]	ssap		SSAP
+ * @return		rの長さ
+ */
+uint16_t llcpHead(uint8_t* r, uint8_t type, uint8_t dsap, uint8_t ssap)
+{
+	r[0] = uint8_t((dsap << 2) | (type >> 2));
+	r[1] = uint8_t(((type & 0x03) << 6) | ssap);
+	return 2;
+}
+
+/**
+ * LLCP(Target側)
+ *
+ * SNEPサーバだけがいる相手として振る舞う.
+ * CONNECTにはCC、Iには1PDUで受け取れるSNEPの応答、DISCにはDMを返し、それ以外はSYMMで応える.
+ *
+ * @param[in]	p			Initiatorからのpdu
+ * @param[in]	len			pの長さ
+ * @param[out]	r			Targetからのpdu
+ * @return		rの長さ
+ */
+uint16_t llcpTarget(const uint8_t* p, uint16_t len, uint8_t* r)
+{
+	const uint8_t PDU_SYMM = 0x00;
+	const uint8_t PDU_CONNECT = 0x04;
+	const uint8_t PDU_DISC = 0x05;
+	const uint8_t PDU_CC = 0x06;
+	const uint8_t PDU_DM = 0x07;
+	const uint8_t PDU_I = 0x0c;
+	const uint8_t SAP_SNEP = 4;
+
+	if(len < 2) {
+		return llcpHead(r, PDU_SYMM, 0, 0);
+	}
+
+	uint8_t type = uint8_t(((p[0] & 0x03) << 2) | (p[1] >> 6));
+	uint8_t ssap = p[1] & 0x3f;
+	uint16_t pos;
+	switch(type) {
+	case PDU_CONNECT:
+		s_LlcpDsap = ssap;
+		s_LlcpSsap = SAP_SNEP;
+		s_LlcpVS = 0;
+		s_LlcpVR = 0;
+		pos = llcpHead(r, PDU_CC, s_LlcpDsap, s_LlcpSsap);
+		break;
+
+	case PDU_I:
+		if((len < 3) || ((p[2] >> 4) != s_LlcpVR)) {
+			return llcpHead(r, PDU_SYMM, 0, 0);
+		}
+		s_LlcpVR = uint8_t((s_LlcpVR + 1) & 0x0f);
+		pos = llcpHead(r, PDU_I, s_LlcpDsap, s_LlcpSsap);
+		r[pos++] = uint8_t((s_LlcpVS << 4) | s_LlcpVR);
+		s_LlcpVS = uint8_t((s_LlcpVS + 1) & 0x0f);
+		r[pos++] = 0x10;		//SNEP Version
+		//PUTだけ受け付ける
+		r[pos++] = ((len >= 5) && (p[4] == 0x02)) ? 0x81 : 0xe0;
+		std::memset(r + pos, 0x00, 4);
+		pos += 4;
+		break;
+
+	case PDU_DISC:
+		pos = llcpHead(r, PDU_DM, ssap, p[0] >> 2);
+		r[pos++] = 0x00;		//DISCによる切断
+		s_LlcpDsap = 0;
+		s_LlcpSsap = 0;
+		break;
+
+	default:
+		pos = llcpHead(r, PDU_SYMM, 0, 0);
+		break;
+	}
+
+	return pos;
+}
+
+/**
+ * NFC-DEP中のInDataExchange
+ *
+ * LLCPならllcpTarget()で応答し、そうでなければ受け取ったデータをそのまま返す.
+ *
+ * @param[in]	d			Initiatorからのデータ
+ * @param[in]	len			dの長さ
+ * @param[out]	r			Targetからのデータ
+ * @return		rの長さ
+ */
+uint16_t depExchange(const uint8_t* d, uint16_t len, uint8_t* r)
+{
+	if(s_bLlcp) {
+		return llcpTarget(d, len, r);
+	}
+	std::memcpy(r, d, len);
+	return len;
+}
+
+/**
+ * PCDコマンド
+ *
+ * @param[in]	c			コマンド(0xd4含む)
+ * @param[in]	len			cの長さ
+ * @param[out]	r			レスポンス(0xd5含む)
+ * @return		rの長さ(0:Error Frame)
+ */
+uint16_t pcdCommand(const uint8_t* c, uint16_t len, uint8_t* r)
+{
+	if((len < 2) || (c[0] != 0xd4)) {
+		return 0;
+	}
+
+	uint16_t pos = 0;
+	r[pos++] = 0xd5;
+	r[pos++] = uint8_t(c[1] + 1);
+
+	switch(c[1]) {
+	case 0x00:		//Diagnose
+		if((len >= 3) && (c[2] == 0x06)) {
+			//Attention Request Test : 活性化したターゲットがいるか
+			r[pos++] = (tgCard(1)) ? 0x00 : STATUS_TIMEOUT;
+			break;
+		}
+		std::memcpy(r + pos, c + 2, len - 2);
+		pos += len - 2;
+		break;
+
+	case 0x02:		//GetFirmwareVersion
+		r[pos++] = 0x33;
+		r[pos++] = 0x01;
+		r[pos++] = 0x30;
+		r[pos++] = 0x07;
+		break;
+
+	case 0x04:		//GetGeneralStatus
+		std::memset(r + pos, 0x00, 5);
+		pos += 5;
+		break;
+
+	case 0x06:		//ReadRegister
+		for(uint16_t i = 2; i + 1 < len; i += 2) {
+			r[pos++] = 0x00;
+		}
+		break;
+
+	case 0x08:		//WriteRegister
+		for(uint16_t i = 2; i + 1 < len; i += 2) {
+			r[pos++] = 0x00;
+		}
+		break;
+
+	case 0x18:		//Reset
+		s_bDep = false;
+		break;
+
+	case 0x10:		//SetSerialBaudRate
+	case 0x12:		//SetParameters
+	case 0x32:		//RFConfiguration
+		break;
+
+	case 0x4a:		//InListPassiveTarget
+		pos = inListPassiveTarget(c, len, r);
+		break;
+
+	case 0x40:		//InDataExchange
+		s_pCard = tgCard(c[2] & 0x0f);
+		if(s_bDep) {
+			r[pos++] = 0x00;
+			pos += (len > 3) ? depExchange(c + 3, len - 3, r + pos) : 0;
+			break;
+		}
+		//fall through
+	case 0x42:		//InCommunicateThru
+	{
+		if(c[1] == 0x42) {
+			s_pCard = tgCard(1);
+		}
+		uint16_t ofs = (c[1] == 0x40) ? 3 : 2;
+		uint16_t res_len = (len > ofs) ? typeACommand(c + ofs, len - ofs, r + 3) : 0;
+		r[pos++] = (res_len) ? 0x00 : STATUS_TIMEOUT;
+		pos += res_len;
+		break;
+	}
+
+	case 0x46:		//InJumpForPSL
+		r[pos++] = STATUS_TIMEOUT;
+		break;
+
+	case 0x56:		//InJumpForDEP
+		pos = inJumpForDep(c, len, r);
+		break;
+
+	case 0x52:		//InRelease
+		s_bDep = false;
+		r[pos++] = 0x00;
+		break;
+
+	case 0xa0:		//CommunicateThruEx
+	{
+		if(s_bDep && (len >= 8) && (c[5] == 0xd4) && (c[6] == 0x0a)) {
+			//RLS_REQ
+			s_bDep = false;
+			r[pos++] = 0x00;
+			r[pos++] = 0x03;
+			r[pos++] = 0xd5;
+			r[pos++] = 0x0b;
+			r[pos++] = c[7];
+			break;
+		}
+		uint16_t res_len;
+		if((len >= 10) && (c[4] == 6) && (c[5] == 0x00) && (c[9] != 0x00)) {
+			res_len = felicaPollingSlots(c + 4, len - 4, r + 3);
+		} else {
+			s_pCard = findCard(HkNfcRw::NFC_F, 0);
+			res_len = (len > 4) ? felicaCommand(c + 4, len - 4, r + 3) : 0;
+		}
+		r[pos++] = (res_len) ? 0x00 : STATUS_TIMEOUT;
+		pos += res_len;
+		break;
+	}
+
+	default:
+		//ターゲット動作などは未対応
+		LOGE("sim : not supported(%02x)\n", c[1]);
+		return 0;
+	}
+
+	return pos;
+}
+
+/**
+ * ホストからのフレームを1つ処理する
+ *
+ * @param[in]	pFrame		コマンド(0xd4含む, 0:DCS異常)
+ * @param[in]	len			pFrameの長さ
+ */
+void execute(const uint8_t* pFrame, uint16_t len)
+{
+	DevSim::Fault fault = takeFault();
+	if(fault == DevSim::FAULT_NO_ACK) {
+		return;
+	}
+
+	//Start Codeに似たbyteを含む雑音
+	const uint8_t NOISE[] = { 0xa5, 0x00, 0xff, 0x00, 0x00, 0x5a };
+	if(fault == DevSim::FAULT_NOISE) {
+		rxPush(NOISE, sizeof(NOISE));
+	}
+	rxPush(ACK, sizeof(ACK));
+	s_RespPos = s_RxLen;
+	s_RespDelay = 0;
+	if(fault == DevSim::FAULT_NO_RESP) {
+		return;
+	}
+
+	uint8_t resp[FRAME_MAX];
+	uint16_t resp_len = (pFrame) ? pcdCommand(pFrame, len, resp) : 0;
+	if((resp_len == 0) || (fault == DevSim::FAULT_ERRFRAME)) {
+		rxPush(ERRFRAME, sizeof(ERRFRAME));
+		return;
+	}
+	if(isRfCommand(pFrame[1]) || ((pFrame[1] == 0x00) && (len >= 3) && (pFrame[2] == 0x06))) {
+		s_RespDelay = s_RfLatency;
+	}
+	if(fault == DevSim::FAULT_NOISE) {
+		rxPush(NOISE, sizeof(NOISE));
+	}
+	rxPushFrame(resp, resp_len, (fault == DevSim::FAULT_BAD_DCS));
+}
+
+/**
+ * ホストからのデータを解釈する
+ */
+void parse()
+{
+	while(true) {
+		uint16_t i = 0;
+		while((i + 2 < s_TxLen)
+		  && !((s_TxBuf[i] == 0x00) && (s_TxBuf[i+1] == 0x00) && (s_TxBuf[i+2] == 0xff))) {
+			i++;
+		}
+		if(i) {
+			std::memmove(s_TxBuf, s_TxBuf + i, s_TxLen - i);
+			s_TxLen -= i;
+		}
+		if(s_TxLen < 6) {
+			return;
+		}
+
+		uint16_t consumed = 3;
+		if((s_TxBuf[3] == 0x00) && (s_TxBuf[4] == 0xff)) {
+			//ACK : 実行中のコマンドを取り消す
+			s_RxLen = 0;
+			s_RxPos = 0;
+			s_RespDelay = 0;
+			consumed = sizeof(ACK);
+		} else {
+			uint16_t pos;
+			uint16_t len;
+			if((s_TxBuf[3] == 0xff) && (s_TxBuf[4] == 0xff)) {
+				if(s_TxLen < 8) {
+					return;
+				}
+				len = uint16_t((s_TxBuf[5] << 8) | s_TxBuf[6]);
+				pos = 8;
+				if((uint8_t(s_TxBuf[5] + s_TxBuf[6] + s_TxBuf[7]) != 0) || (len > FRAME_MAX)) {
+					//読み捨てて次を探す
+					len = 0;
+				}
+			} else {
+				len = s_TxBuf[3];
+				pos = 5;
+				if(uint8_t(s_TxBuf[3] + s_TxBuf[4]) != 0) {
+					len = 0;
+				}
+			}
+			if(len) {
+				if(s_TxLen < pos + len + 2) {
+					return;
+				}
+				uint8_t sum = 0;
+				for(uint16_t j = 0; j < len; j++) {
+					sum += s_TxBuf[pos + j];
+				}
+				bool bDcs = (uint8_t(sum + s_TxBuf[pos + len]) == 0);
+				execute((bDcs) ? s_TxBuf + pos : 0, len);
+				consumed = uint16_t(pos + len + 2);
+			}
+		}
+		std::memmove(s_TxBuf, s_TxBuf + consumed, s_TxLen - consumed);
+		s_TxLen -= consumed;
+	}
+}
+
+/**
+ * ホストからのデータを受け取る
+ */
+void txPush(const uint8_t* data, uint16_t len)
+{
+	if(s_TxLen + len > BUF_SIZE) {
+		LOGE("sim : tx overflow\n");
+		s_TxLen = 0;
+		return;
+	}
+	std::memcpy(s_TxBuf + s_TxLen, data, len);
+	s_TxLen += len;
+}
+
+}	//namespace
+
+
+/**
+ * @brief		擬似PCDの設定
+ */
+namespace DevSim {
+
+/**
+ * カード設定
+ *
+ * @param[in]	pCard		カード(0:カードなし). 内容はコピーする(pMemoryは参照のまま)
+ */
+void setCard(const Card* pCard)
+{
+	setCards(pCard, (pCard) ? 1 : 0);
+}
+
+/**
+ * 複数のカード設定
+ *
+ * 重ねてかざしたカードとして、InListPassiveTargetのMaxTgまでpCardsの順に応答する.
+ * FeliCaのコマンドはIDmが一致するカードが、NFC-AのコマンドはTgのカードが受ける.
+ *
+ * @param[in]	pCards		カード. 内容はコピーする(pMemoryは参照のまま)
+ * @param[in]	num			pCardsの数(0:カードなし, 4枚まで)
+ */
+void setCards(const Card* pCards, uint8_t num)
+{
+	if(num > CARD_MAX) {
+		LOGE("sim : too many cards(%d)\n", num);
+		num = CARD_MAX;
+	}
+	for(uint8_t i = 0; i < num; i++) {
+		s_Cards[i] = pCards[i];
+	}
+	s_CardNum = num;
+	s_CardGen++;
+}
+
+/**
+ * RF通信を伴うコマンドのレスポンスまでの時間
+ *
+ * @param[in]	usec		時間[usec]
+ */
+void setRfLatency(uint32_t usec)
+{
+	s_RfLatency = usec;
+}
+
+/**
+ * UARTの転送時間を待つかどうか
+ *
+ * @param[in]	bEnable		trueなら1byteあたり10bit分を通信速度から計算して待つ
+ */
+void setWireDelay(bool bEnable)
+{
+	s_bWireDelay = bEnable;
+}
+
+/**
+ * NFC-DEPのTargetがいるかどうか
+ *
+ * @param[in]	bEnable		trueならInJumpForDEPに応答し、その後のInDataExchangeを受ける
+ */
+void setDepTarget(bool bEnable)
+{
+	s_bDepTarget = bEnable;
+}
+
+/**
+ * 次のcount回のコマンドに異常を起こす
+ *
+ * @param[in]	fault		異常
+ * @param[in]	count		回数
+ */
+void injectFault(Fault fault, uint16_t count/*=1*/)
+{
+	s_Fault = fault;
+	s_FaultCount = (fault == FAULT_NONE) ? 0 : count;
+}
+
+}	//namespace DevSim
+
+
+/**
+ * @brief		擬似PCD用のI/F
+ */
+namespace DevAccess {
+
+/**
+ * ポートオープン
+ *
+ * @param[in]	pPath	未使用
+ *
+ * @retval	true	オープン成功
+ */
+bool open(const char* pPath/*=0*/)
+{
+	(void)pPath;
+	s_bOpened = true;
+	s_Baud = 115200;
+	s_TxLen = 0;
+	s_RxLen = 0;
+	s_RxPos = 0;
+	s_RespDelay = 0;
+	s_bDep = false;
+	return true;
+}
+
+
+/**
+ * ポートクローズ
+ */
+void close()
+{
+	s_bOpened = false;
+}
+
+
+/**
+ * ポート送信
+ *
+ * @param[in]	data		送信データ
+ * @param[in]	len			dataの長さ
+ * @return					送信したサイズ
+ */
+uint16_t write(const uint8_t* data, uint16_t len)
+{
+	Segment seg;
+	seg.pData = data;
+	seg.Len = len;
+	return writev(&seg, 1);
+}
+
+/**
+ * ポート送信(複数データ)
+ *
+ * @param[in]	seg			送信データの断片
+ * @param[in]	num			segの数
+ * @return					送信したサイズ
+ */
+uint16_t writev(const Segment* seg, uint8_t num)
+{
+	if(!s_bOpened) {
+		return 0;
+	}
+
+	uint16_t len = 0;
+	for(uint8_t i = 0; i < num; i++) {
+#ifdef DBG_WRITEDATA
+		for(int j=0; j<seg[i].Len; j++) {
+			LOGD("[W]%02x ", seg[i].pData[j]);
+		}
+#endif
+		txPush(seg[i].pData, seg[i].Len);
+		len += seg[i].Len;
+	}
+	parse();
+
+	return len;
+}
+
+/**
+ * 送信後の待ち方設定
+ *
+ * @param[in]	policy		送信後の待ち方
+ *
+ * @note		- 送信はすぐに終わるので、何もしない.
+ */
+void setWritePolicy(WritePolicy policy)
+{
+	(void)policy;
+}
+
+/**
+ * 通信速度を変更できるか
+ *
+ * @param[in]	baud		通信速度[bps]
+ * @retval	true	変更できる
+ */
+bool checkBaudRate(uint32_t baud)
+{
+	return (baud >= 9600) && (baud <= 921600);
+}
+
+/**
+ * 通信速度変更
+ *
+ * @param[in]	baud		通信速度[bps]
+ * @retval	true	成功
+ *
+ * @note		- #DevSim::setWireDelay() が有効なときの転送時間にだけ影響する.
+ */
+bool setBaudRate(uint32_t baud)
+{
+	if(!checkBaudRate(baud)) {
+		return false;
+	}
+	s_Baud = baud;
+	return true;
+}
+
+/**
+ * 受信
+ *
+ * @param[out]	data		受信バッファ
+ * @param[in]	len			受信サイズ
+ *
+ * @return					受信したサイズ
+ *
+ * @note		- レスポンスがない場合は待たずに戻る(実機ではタイムアウトになる).
+ */
+uint16_t read(uint8_t* data, uint16_t len)
+{
+	uint16_t ret_len = s_RxLen - s_RxPos;
+	if(ret_len > len) {
+		ret_len = len;
+	}
+
+	uint32_t wait = 0;
+	if(s_RespDelay && (s_RxPos + ret_len > s_RespPos)) {
+		wait += s_RespDelay;
+		s_RespDelay = 0;
+	}
+	if(s_bWireDelay) {
+		wait += uint32_t(uint64_t(ret_len) * 10 * 1000000 / s_Baud);
+	}
+	if(wait) {
+		usleep(wait);
+	}
+
+	std::memcpy(data, s_RxBuf + s_RxPos, ret_len);
+	s_RxPos += ret_len;
+	if(s_RxPos == s_RxLen) {
+		s_RxPos = 0;
+		s_RxLen = 0;
+	}
+	if(ret_len != len) {
+		LOGE("read err: ret_len=%d\n", ret_len);
+	}
+
+#ifdef DBG_READDATA
+	LOGD("read(%d)", ret_len);
+	for(int i=0; i<ret_len; i++) {
+		LOGD("[R]%02x", data[i]);
+	}
+#endif
+
+	return ret_len;
+}
+
+}	//namespace DevAccess
@@ -0,0 +1,59 @@
+#ifndef DEVACCESS_SIM_H
+#define DEVACCESS_SIM_H
+
+#include <stdint.h>
+#include "HkNfcRw.h"
+
+/**
+ * @brief	擬似PCD(devaccess_sim.cpp)の設定
+ *
+ * devaccess_sim.cppはDevAccessの実装で、RC-S620/Sのフレーム(ACK, Normal/Extendedフレーム,
+ * DCS, Error Frame)とカード1枚、NFC-DEPのTarget1つの振る舞いをプロセス内で真似する.
+ * 実機なしでNfcPcd以上を動かしたり、性能を測ったりするのに使う.
+ *
+ * 設定は全スレッド共通なので、HkNfcRw::open()より前に済ませておくこと.
+ */
+namespace DevSim {
+
+	/// @struct	Card
+	/// @brief	かざしているカード
+	struct Card {
+		HkNfcRw::Type	Type;				///< NFCタイプ
+		uint8_t			NfcId[10];			///< IDm(NFC-F) / UID(NFC-A) / NFCID0(NFC-B)
+		uint8_t			NfcIdLen;			///< NfcIdの長さ
+		uint8_t			PMm[8];				///< PMm(NFC-F)
+		uint16_t		SystemCode;			///< システムコード(NFC-F)
+		uint8_t			ReadBlockMax;		///< 1コマンドで読めるブロック数(NFC-F)
+		uint8_t			WriteBlockMax;		///< 1コマンドで書けるブロック数(NFC-F)
+		uint8_t*		pMemory;			///< メモリ(16byte x BlockNum)
+		uint16_t		BlockNum;			///< pMemoryのブロック数
+		bool			bOnly212K;			///< 424kbpsのpollingに応答しない(NFC-F)
+		uint8_t			SelRes;				///< SEL_RES(NFC-A)
+	};
+
+	/// @enum	Fault
+	/// @brief	次のコマンドに起こす異常
+	enum Fault {
+		FAULT_NONE,			///< なし
+		FAULT_NO_ACK,		///< ACKもレスポンスも返さない
+		FAULT_NO_RESP,		///< ACKだけ返す
+		FAULT_ERRFRAME,		///< レスポンスの代わりにError Frameを返す
+		FAULT_BAD_DCS,		///< レスポンスのDCSを壊す
+		FAULT_NOISE			///< ACKとレスポンスの前に雑音を混ぜる
+	};
+
+	/// カード設定(0:カードなし)
+	void setCard(const Card* pCard);
+	/// 重ねてかざしたカードの設定
+	void setCards(const Card* pCards, uint8_t num);
+	/// RF通信を伴うコマンドのレスポンスまでの時間[usec]
+	void setRfLatency(uint32_t usec);
+	/// UARTの転送時間を通信速度から計算して待つかどうか
+	void setWireDelay(bool bEnable);
+	/// NFC-DEPのTarget(LLCP/SNEPサーバ)がいるかどうか
+	void setDepTarget(bool bEnable);
+	/// 次のcount回のコマンドに異常を起こす
+	void injectFault(Fault fault, uint16_t count=1);
+}
+
+#endif /* DEVACCESS_SIM_H */
@@ -6,8 +6,8 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <termios.h>
-#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "devaccess.h"
 #include "nfclog.h"
@@ -21,28 +21,139 @@
 * @brief		RC-S620/S用のI/F
 */
 namespace DevAccess {
+namespace {
 	const char* NFCPCD_DEV = "/dev/ttyS15";		//COM16
 //	const char* NFCPCD_DEV = "/dev/ttyUSB0";
 
-	int s_fd = -1;		///< シリアルポートのファイルディスクリプタ
+	HKNFC_TLS int s_fd = -1;		///< シリアルポートのファイルディスクリプタ
+	HKNFC_TLS WritePolicy s_WritePolicy = WP_NONE;	///< 送信後の待ち方
+
+	/// 受信リングバッファサイズ(2のべき乗)
+	const uint16_t RXBUF_SIZE = 512;
+	HKNFC_TLS uint8_t s_RxBuf[RXBUF_SIZE];	///< 受信リングバッファ
+	HKNFC_TLS uint16_t s_RxRead = 0;			///< 次に取り出す位置
+	HKNFC_TLS uint16_t s_RxWrite = 0;			///< 次に書き込む位置
+
+/**
+ * 受信リングバッファに溜まっているサイズ
+ */
+inline uint16_t rxCount()
+{
+	return uint16_t((s_RxWrite - s_RxRead) & (RXBUF_SIZE - 1));
+}
+
+/**
+ * 受信リングバッファから取り出す
+ *
+ * @param[out]	data		取り出し先
+ * @param[in]	len			取り出すサイズ(rxCount()以下)
+ */
+void rxPop(uint8_t* data, uint16_t len)
+{
+	while(len) {
+		uint16_t n = RXBUF_SIZE - s_RxRead;
+		if(n > len) {
+			n = len;
+		}
+		std::memcpy(data, s_RxBuf + s_RxRead, n);
+		s_RxRead = (s_RxRead + n) & (RXBUF_SIZE - 1);
+		data += n;
+		len -= n;
+	}
+}
+
+/**
+ * 受信リングバッファに読めるだけ読み込む
+ *
+ * @return		読み込んだサイズ(0は読み込めず)
+ */
+ssize_t rxFill()
+{
+	//リングバッファは1byte空けておく(満杯と空を区別するため)
+	uint16_t space = RXBUF_SIZE - 1 - rxCount();
+	uint16_t n = RXBUF_SIZE - s_RxWrite;
+	if(n > space) {
+		n = space;
+	}
+	if(n == 0) {
+		return 0;
+	}
+	ssize_t sz = ::read(s_fd, s_RxBuf + s_RxWrite, n);
+	if(sz > 0) {
+		s_RxWrite = (s_RxWrite + sz) & (RXBUF_SIZE - 1);
+	}
+	return sz;
+}
+
+/**
+ * 通信速度をtermiosの値に変換
+ *
+ * @param[in]	baud		通信速度[bps]
+ * @return		termiosの値(B0:未対応)
+ */
+speed_t toSpeed(uint32_t baud)
+{
+	switch(baud) {
+	case 9600:		return B9600;
+	case 19200:		return B19200;
+	case 38400:		return B38400;
+	case 57600:		return B57600;
+	case 115200:	return B115200;
+#ifdef B230400
+	case 230400:	return B230400;
+#endif
+#ifdef B460800
+	case 460800:	return B460800;
+#endif
+#ifdef B921600
+	case 921600:	return B921600;
+#endif
+	default:		return B0;
+	}
+}
+
+/**
+ * 送信後の待ち
+ */
+void writeWait()
+{
+	switch(s_WritePolicy) {
+	case WP_DRAIN:
+		tcdrain(s_fd);
+		break;
+	case WP_FSYNC:
+		fsync(s_fd);
+		break;
+	default:
+		break;
+	}
+}
+
+}	//namespace
 
 /**
  * ポートオープン
  *
+ * @param[in]	pPath	デバイスパス(0なら #NFCPCD_DEV)
+ *
  * @retval	true	オープン成功
  */
-bool open()
+bool open(const char* pPath/*=0*/)
 {
 	if(s_fd != -1) {
 		LOGI("already opened");
 		return true;
 	}
 
+	if(pPath == 0) {
+		pPath = NFCPCD_DEV;
+	}
+
 	//シリアルオープン
 #ifndef __CYGWIN__
-	s_fd = ::open(NFCPCD_DEV, O_RDWR /*| O_NONBLOCK*/);
+	s_fd = ::open(pPath, O_RDWR /*| O_NONBLOCK*/);
 #else
-	s_fd = ::open(NFCPCD_DEV, O_RDWR);	//cygwinだとnon-blockがうまく動かん
+	s_fd = ::open(pPath, O_RDWR);	//cygwinだとnon-blockがうまく動かん
 #endif
 	if(s_fd == -1) {
 		LOGE("open fail.");
@@ -73,6 +184,84 @@ void close()
 {
 	::close(s_fd);
 	s_fd = -1;
+	s_RxRead = 0;
+	s_RxWrite = 0;
+}
+
+
+/**
+ * 送信後の待ち方設定
+ *
+ * @param[in]	policy		送信後の待ち方
+ *
+ * @note		- 以前はfsync()固定だったが、ttyに対しては意味がなく遅いだけなので
+ * 				  デフォルトは #WP_NONE とした(応答待ちで送信完了は分かる).
+ */
+void setWritePolicy(WritePolicy policy)
+{
+	s_WritePolicy = policy;
+}
+
+
+/**
+ * 通信速度を変更できるか
+ *
+ * 実際にttyへ設定して読み戻し、受け付けられたかを確かめる.
+ * 確かめた後は元の設定に戻す.
+ *
+ * @param[in]	baud		通信速度[bps]
+ * @retval	true	変更できる
+ */
+bool checkBaudRate(uint32_t baud)
+{
+	speed_t spd = toSpeed(baud);
+	struct termios org;
+	if((spd == B0) || (tcgetattr(s_fd, &org) != 0)) {
+		return false;
+	}
+
+	struct termios ter = org;
+	if(cfsetspeed(&ter, spd) != 0) {
+		return false;
+	}
+	//tcsetattr()は一部でも反映できれば成功を返すので、読み戻して確かめる
+	bool ret = (tcsetattr(s_fd, TCSADRAIN, &ter) == 0)
+			&& (tcgetattr(s_fd, &ter) == 0)
+			&& (cfgetispeed(&ter) == spd) && (cfgetospeed(&ter) == spd);
+	if(tcsetattr(s_fd, TCSANOW, &org) != 0) {
+		LOGE("checkBaudRate : %s\n", strerror(errno));
+		return false;
+	}
+	return ret;
+}
+
+/**
+ * 通信速度変更
+ *
+ * 送信済みのデータを出し切ってから切り替える.
+ *
+ * @param[in]	baud		通信速度[bps]
+ * @retval	true	成功
+ */
+bool setBaudRate(uint32_t baud)
+{
+	struct termios ter;
+	if(!checkBaudRate(baud) || (tcgetattr(s_fd, &ter) != 0)) {
+		LOGE("setBaudRate : not supported(%u)\n", baud);
+		return false;
+	}
+	cfsetspeed(&ter, toSpeed(baud));
+	if(tcsetattr(s_fd, TCSADRAIN, &ter) != 0) {
+		LOGE("setBaudRate : %s\n", strerror(errno));
+		return false;
+	}
+
+	//切り替え前後の受信データは使えない
+	tcflush(s_fd, TCIFLUSH);
+	s_RxRead = 0;
+	s_RxWrite = 0;
+
+	return true;
 }
 
 
@@ -106,14 +295,80 @@ uint16_t write(const uint8_t* data, uint16_t len)
 		len -= ret_len;
 		data += ret_len;
 	} while(len);
-	fsync(s_fd);
+	writeWait();
 
 	return ret_len;
 }
 
+/**
+ * ポート送信(複数データ)
+ *
+ * segを順に連結したものを1回のシステムコールで送信する.
+ *
+ * @param[in]	seg			送信データの断片
+ * @param[in]	num			segの数
+ * @return					送信したサイズ
+ */
+uint16_t writev(const Segment* seg, uint8_t num)
+{
+	const uint8_t SEG_MAX = 8;
+	if(num > SEG_MAX) {
+		LOGE("_port_writev:too many segments(%d)", num);
+		return 0;
+	}
+
+	struct iovec iov[SEG_MAX];
+	uint16_t len = 0;
+	for(uint8_t i = 0; i < num; i++) {
+		iov[i].iov_base = const_cast<uint8_t*>(seg[i].pData);
+		iov[i].iov_len = seg[i].Len;
+		len += seg[i].Len;
+	}
+
+#ifdef DBG_WRITEDATA
+	LOGD("writev(%d):", len);
+	for(uint8_t i = 0; i < num; i++) {
+		for(int j=0; j<seg[i].Len; j++) {
+			LOGD("[W]%02x ", seg[i].pData[j]);
+		}
+	}
+#endif
+
+	uint16_t total = 0;
+	struct iovec* pIov = iov;
+	int iov_num = num;
+	while(total < len) {
+		errno = 0;
+		ssize_t ret_len = ::writev(s_fd, pIov, iov_num);
+		if(ret_len <= 0) {
+			LOGE("_port_writev:%s", strerror(errno));
+			break;
+		}
+		total += ret_len;
+
+		//途中まで送信した場合は、残りから再送する
+		while(iov_num && (size_t)ret_len >= pIov->iov_len) {
+			ret_len -= pIov->iov_len;
+			pIov++;
+			iov_num--;
+		}
+		if(iov_num) {
+			pIov->iov_base = (uint8_t*)pIov->iov_base + ret_len;
+			pIov->iov_len -= ret_len;
+		}
+	}
+	writeWait();
+
+	return total;
+}
+
 /**
  * 受信
  *
+ * 受信済みのデータはリングバッファに溜めておき、足りない場合だけ
+ * デバイスから読めるだけ読み込む.
+ * ACKとレスポンスが続けて届いていれば、1回のread(2)でまとめて取り込まれる.
+ *
  * @param[out]	data		受信バッファ
  * @param[in]	len			受信サイズ
  *
@@ -128,33 +383,34 @@ uint16_t read(uint8_t* data, uint16_t len)
 
 #ifndef __CYGWIN__
 
-	fd_set fds;
-	FD_ZERO(&fds);
-	FD_SET(s_fd, &fds);
-
 	struct timeval tv;
 	tv.tv_sec = 1;
 	tv.tv_usec = 0;
-	do {
+	while(true) {
+		uint16_t n = rxCount();
+		if(n > len - ret_len) {
+			n = len - ret_len;
+		}
+		rxPop(data + ret_len, n);
+		ret_len += n;
+		if(ret_len >= len) {
+			break;
+		}
+
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(s_fd, &fds);
 		errno = 0;
-		int result  = ::select(FD_SETSIZE, &fds, (fd_set *)0, (fd_set *)0, &tv);
+		int result  = ::select(s_fd + 1, &fds, (fd_set *)0, (fd_set *)0, &tv);
 		if(result <= 0) {
 			LOGE("read err: result=%d ret_len=%d [%s]", result, ret_len, strerror(errno));
 			break;
 		}
-		else {
-			if(FD_ISSET(s_fd, &fds)) {
-				int nr;
-				ioctl(s_fd, FIONREAD, &nr);
-				//LOGD("ret : %d", ret);
-				if(ret_len + nr > len) {
-					nr = len - ret_len;
-				}
-				ssize_t sz = ::read(s_fd, data, nr);
-				ret_len += sz;
-			}
+		if(rxFill() <= 0) {
+			LOGE("read err: [%s]", strerror(errno));
+			break;
 		}
-	} while(ret_len < len);
+	}
 
 #ifdef DBG_READDATA
 	LOGD("read(%d)", ret_len);
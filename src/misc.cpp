@@ -1,12 +1,14 @@
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 #include "nfclog.h"
 #include "misc.h"
+#include "HkNfcTls.h"
 
 namespace HkNfcRwMisc {
 
-static timeval s_TimeVal;
-static uint16_t s_Timeout = 0;
+static HKNFC_TLS timeval s_TimeVal;
+static HKNFC_TLS uint16_t s_Timeout = 0;
 
 /**
  *  @brief	~bX[v
@@ -55,4 +57,17 @@ bool isTimeout()
 	return b;
 }
 
+
+/**
+ * ݎ
+ *
+ * @return	CLOCK_MONOTONIC̎[usec]
+ */
+uint64_t nowUsec()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 }	//namespace HkNfcRwMisc
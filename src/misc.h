@@ -45,6 +45,7 @@ inline uint16_t hl16(uint8_t h8, uint8_t l8) {
 void msleep(uint16_t msec);
 void startTimer(uint16_t tmval);
 bool isTimeout();
+uint64_t nowUsec();
 
 /// @}
 
@@ -0,0 +1,38 @@
+#ifndef NFCCAPTURE_H
+#define NFCCAPTURE_H
+
+#include <stdint.h>
+
+/**
+ * @brief	ホストとPCDの間のバイト列のキャプチャファイル形式
+ *
+ * NfcPcd::startCapture()が書き、devaccess_replay.cppが読む.
+ * 数値はすべてリトルエンディアン.
+ *
+ * - ファイルヘッダ(8byte)
+ *   - [0-3]	"HKNC"
+ *   - [4-5]	バージョン(#VERSION)
+ *   - [6-7]	予約(0)
+ * - レコード(7byte + データ)を書いた順に並べる
+ *   - [0]		向き(#Dir)
+ *   - [1-2]	データ長
+ *   - [3-6]	前のレコードからの経過時間[usec](最初のレコードはキャプチャ開始から)
+ *   - [7-]		データ
+ *
+ * TXは1回のwrite/writev(フレーム1つかACK)、RXは1回のreadで受け取った分を1レコードにする.
+ */
+namespace NfcCapture {
+	const uint8_t MAGIC[4] = { 'H', 'K', 'N', 'C' };
+	const uint16_t VERSION = 1;
+	const uint16_t FILEHEAD_LEN = 8;		///< ファイルヘッダの長さ
+	const uint16_t RECHEAD_LEN = 7;			///< レコードヘッダの長さ
+
+	/// @enum	Dir
+	/// @brief	レコードの向き
+	enum Dir {
+		DIR_TX = 0,		///< ホスト→PCD
+		DIR_RX = 1		///< PCD→ホスト
+	};
+}
+
+#endif /* NFCCAPTURE_H */
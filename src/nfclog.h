@@ -1,19 +1,60 @@
 #ifndef NFCLOG_H
 #define NFCLOG_H
 
-#define HKNFCRW_ENABLE_DEBUG
+/*
+ * ログレベル
+ *
+ * HKNFCRW_LOG_LEVELより詳しいレベルのログは、マクロごと消えて何も生成しない.
+ * ビルド時に -DHKNFCRW_LOG_LEVEL=HKNFCRW_LOG_DEBUG のように指定する.
+ * HKNFCRW_ENABLE_DEBUGを定義したときは、指定がなければDEBUGまで出す.
+ */
+#define HKNFCRW_LOG_NONE	0		///< 出さない
+#define HKNFCRW_LOG_ERROR	1		///< LOGEだけ
+#define HKNFCRW_LOG_INFO	2		///< LOGE, LOGI
+#define HKNFCRW_LOG_DEBUG	3		///< LOGE, LOGI, LOGD
 
+#ifndef HKNFCRW_LOG_LEVEL
 #ifdef HKNFCRW_ENABLE_DEBUG
+#define HKNFCRW_LOG_LEVEL	HKNFCRW_LOG_DEBUG
+#else
+#define HKNFCRW_LOG_LEVEL	HKNFCRW_LOG_INFO
+#endif
+#endif	//HKNFCRW_LOG_LEVEL
+
+#if HKNFCRW_LOG_LEVEL > HKNFCRW_LOG_NONE
 #include <stdio.h>
-#define LOGI	printf
+#endif
+
+#if HKNFCRW_LOG_LEVEL >= HKNFCRW_LOG_ERROR
 #define LOGE	printf
-#define LOGD	printf
+#else
+#define LOGE(...)
+#endif
 
+#if HKNFCRW_LOG_LEVEL >= HKNFCRW_LOG_INFO
+#define LOGI	printf
 #else
 #define LOGI(...)
-#define LOGE(...)
+#endif
+
+#if HKNFCRW_LOG_LEVEL >= HKNFCRW_LOG_DEBUG
+#define LOGD	printf
+#else
 #define LOGD(...)
+#endif
+
 
-#endif	//HKNFCRW_ENABLE_DEBUG
+/*
+ * バイナリトレース
+ *
+ * HKNFCRW_ENABLE_TRACEを定義したときだけ、フレームやイベントをHkNfcTraceのリングバッファに残す.
+ * 定義しなければNFCTRACEは何も生成しない.
+ */
+#ifdef HKNFCRW_ENABLE_TRACE
+#include "HkNfcTrace.h"
+#define NFCTRACE(kind, ...)	HkNfcTrace::record(HkNfcTrace::kind, __VA_ARGS__)
+#else
+#define NFCTRACE(kind, ...)
+#endif
 
 #endif /* NFCLOG_H */